@@ -0,0 +1,454 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "lex/dfa.h"
+#include "lex/multi_dfa.h"
+#include "bench/corpus.h"
+
+// Benchmark suite for parse, build and match.
+//
+// Each benchmark compiles a synthetic pattern which stresses a specific cost
+// and runs lex::dfa::search() over a generated corpus (one search per line),
+// and then the early-termination modes over the same lines: is_match() with
+// the unanchored DFA and count() with the reverse DFA. The results are
+// printed as JSON lines, one object per benchmark.
+//
+// The multi_dfa family looks for n words in each line, first with one
+// is_match() per word and then with the unanchored DFAs (".*(word)") in
+// every lex::multi_dfa kernel which the DFAs and the CPU support.
+
+namespace {
+  struct benchmark {
+    std::string family;
+    size_t n;
+    std::string pattern;
+    bench::corpus::alphabet alphabet;
+    std::vector<std::string> samples;
+  };
+
+  // Wide classes: n consecutive printable-ASCII classes.
+  benchmark wide_class(size_t n)
+  {
+    benchmark b;
+    b.family = "wide_class";
+    b.n = n;
+
+    for (size_t i = 0; i < n; i++) {
+      b.pattern += "[ -~]";
+    }
+
+    b.pattern += "\\t";
+
+    b.alphabet = bench::corpus::alphabet::printable;
+    b.samples.push_back(std::string(n, 'x') + "\t");
+
+    return b;
+  }
+
+  // Deep nesting: ((((a)*b)*c)* ...).
+  benchmark deep_nesting(size_t n)
+  {
+    benchmark b;
+    b.family = "deep_nesting";
+    b.n = n;
+
+    std::string sample;
+    for (size_t i = 0; i < n; i++) {
+      b.pattern += "(";
+    }
+
+    for (size_t i = 0; i < n; i++) {
+      char c = 'a' + (i % 26);
+
+      b.pattern += c;
+      b.pattern += ")*";
+
+      sample += c;
+    }
+
+    b.pattern += "!";
+    sample += "!";
+
+    b.alphabet = bench::corpus::alphabet::lowercase;
+    b.samples.push_back(sample);
+
+    return b;
+  }
+
+  // Exponential blowup: (a|b)*a(a|b)(a|b)...(a|b).
+  benchmark blowup(size_t n)
+  {
+    benchmark b;
+    b.family = "blowup";
+    b.n = n;
+
+    b.pattern = "(a|b)*a";
+    for (size_t i = 0; i < n; i++) {
+      b.pattern += "(a|b)";
+    }
+
+    b.alphabet = bench::corpus::alphabet::ab;
+    b.samples.push_back("a" + std::string(n, 'b'));
+
+    return b;
+  }
+
+  // Large literal alternation: (word1)|(word2)|...|(wordn).
+  benchmark literal_alternation(size_t n)
+  {
+    benchmark b;
+    b.family = "literal_alternation";
+    b.n = n;
+
+    bench::corpus::random rnd(n);
+
+    for (size_t i = 0; i < n; i++) {
+      std::string word = rnd.word(5, 10);
+
+      if (i > 0) {
+        b.pattern += "|";
+      }
+
+      b.pattern += "(" + word + ")";
+      b.samples.push_back(word);
+    }
+
+    b.alphabet = bench::corpus::alphabet::lowercase;
+
+    return b;
+  }
+
+  double percentile(std::vector<double>& v, double p)
+  {
+    if (v.empty()) {
+      return 0.0;
+    }
+
+    size_t idx = static_cast<size_t>(p * (v.size() - 1));
+    std::nth_element(v.begin(), v.begin() + idx, v.end());
+
+    return v[idx];
+  }
+
+  bool run(const benchmark& b, size_t corpus_size, size_t iterations)
+  {
+    // Compile.
+    lex::stats st;
+    double start = lex::stats::now();
+
+    lex::regular_expression regex;
+    if (!regex.parse(b.pattern.c_str(), &st)) {
+      fprintf(stderr, "%s/%zu: error parsing regular expression.\n",
+              b.family.c_str(),
+              b.n);
+
+      return false;
+    }
+
+    lex::dfa dfa;
+    if (!dfa.build(regex, &st)) {
+      fprintf(stderr, "%s/%zu: error building DFA.\n", b.family.c_str(), b.n);
+      return false;
+    }
+
+    double compile_time = lex::stats::now() - start;
+
+    // DFAs of the early-termination modes.
+    lex::dfa unanchored, reverse;
+    if ((!unanchored.build_unanchored(regex)) ||
+        (!reverse.build_reverse(regex, true))) {
+      fprintf(stderr, "%s/%zu: error building DFA.\n", b.family.c_str(), b.n);
+      return false;
+    }
+
+    // Generate corpus.
+    bench::corpus corpus;
+    corpus.generate(b.alphabet, b.samples, corpus_size, b.n);
+
+    // Match.
+    std::vector<double> latencies;
+    latencies.reserve(corpus.lines().size() * iterations);
+
+    size_t matches = 0;
+    double match_time = 0.0;
+
+    for (size_t it = 0; it < iterations; it++) {
+      for (const std::string& line : corpus.lines()) {
+        size_t s, e;
+
+        double t0 = lex::stats::now();
+        bool found = dfa.search(line.data(), line.size(), s, e);
+        double t1 = lex::stats::now();
+
+        latencies.push_back(t1 - t0);
+        match_time += t1 - t0;
+
+        if (found) {
+          matches++;
+        }
+      }
+    }
+
+    // Early-termination modes.
+    size_t hits = 0;
+    double t0 = lex::stats::now();
+
+    for (size_t it = 0; it < iterations; it++) {
+      for (const std::string& line : corpus.lines()) {
+        if (unanchored.is_match(line.data(), line.size())) {
+          hits++;
+        }
+      }
+    }
+
+    double is_match_time = lex::stats::now() - t0;
+
+    size_t count = 0;
+    t0 = lex::stats::now();
+
+    for (size_t it = 0; it < iterations; it++) {
+      for (const std::string& line : corpus.lines()) {
+        count += dfa.count(reverse, line.data(), line.size());
+      }
+    }
+
+    double count_time = lex::stats::now() - t0;
+
+    if (hits != matches) {
+      fprintf(stderr,
+              "%s/%zu: is_match() and search() disagree.\n",
+              b.family.c_str(),
+              b.n);
+
+      return false;
+    }
+
+    double mb = (static_cast<double>(corpus.size()) * iterations) /
+                (1024.0 * 1024.0);
+
+    printf("{\"family\": \"%s\", \"n\": %zu, \"positions\": %zu, "
+           "\"states\": %zu, \"transitions\": %zu, "
+           "\"parse_s\": %.6f, \"build_s\": %.6f, \"compile_s\": %.6f, "
+           "\"peak_bytes\": %zu, \"table_bytes\": %zu, "
+           "\"corpus_bytes\": %zu, \"matches\": %zu, "
+           "\"throughput_mb_s\": %.2f, "
+           "\"latency_p50_ns\": %.0f, \"latency_p90_ns\": %.0f, "
+           "\"latency_p99_ns\": %.0f, "
+           "\"is_match_mb_s\": %.2f, \"count\": %zu, "
+           "\"count_mb_s\": %.2f}\n",
+           b.family.c_str(),
+           b.n,
+           st.positions,
+           st.states,
+           st.transitions,
+           st.parse_time + st.init_time,
+           st.followpos_time + st.subset_time,
+           compile_time,
+           st.peak_bytes,
+           dfa.number_states() * dfa.number_classes() * sizeof(lex::state_id),
+           corpus.size(),
+           matches / iterations,
+           (match_time > 0.0) ? mb / match_time : 0.0,
+           percentile(latencies, 0.50) * 1e9,
+           percentile(latencies, 0.90) * 1e9,
+           percentile(latencies, 0.99) * 1e9,
+           (is_match_time > 0.0) ? mb / is_match_time : 0.0,
+           count / iterations,
+           (count_time > 0.0) ? mb / count_time : 0.0);
+
+    fflush(stdout);
+
+    return true;
+  }
+
+  bool run_multi(size_t n, size_t corpus_size, size_t iterations)
+  {
+    // 2-byte words: the DFAs of up to 5 of them fit in the shuffle kernel.
+    bench::corpus::random rnd(n);
+
+    std::vector<std::string> words;
+    std::vector<lex::dfa> dfas(n);
+    lex::multi_dfa multi;
+
+    for (size_t i = 0; i < n; i++) {
+      words.push_back(rnd.word(2, 2));
+
+      // is_match() searches the word, the multi-DFA scans for a prefix
+      // which ends with it.
+      std::string pattern = ".*(" + words.back() + ")";
+
+      lex::regular_expression word, unanchored;
+      lex::dfa d;
+
+      if ((!word.parse(words.back().c_str())) ||
+          (!dfas[i].build(word)) ||
+          (!unanchored.parse(pattern.c_str())) ||
+          (!d.build(unanchored)) ||
+          (!multi.add(d))) {
+        fprintf(stderr, "multi_dfa/%zu: error building DFA.\n", n);
+        return false;
+      }
+    }
+
+    bench::corpus corpus;
+    corpus.generate(bench::corpus::alphabet::lowercase,
+                    words,
+                    corpus_size,
+                    n);
+
+    // One pass per DFA.
+    std::vector<uint32_t> masks;
+    masks.reserve(corpus.lines().size());
+
+    double t0 = lex::stats::now();
+
+    for (size_t it = 0; it < iterations; it++) {
+      masks.clear();
+
+      for (const std::string& line : corpus.lines()) {
+        uint32_t mask = 0;
+
+        for (size_t i = 0; i < n; i++) {
+          if (dfas[i].is_match(line.data(), line.size())) {
+            mask |= static_cast<uint32_t>(1) << i;
+          }
+        }
+
+        masks.push_back(mask);
+      }
+    }
+
+    double separate_time = lex::stats::now() - t0;
+
+    size_t matches = 0;
+    for (uint32_t mask : masks) {
+      matches += __builtin_popcount(mask);
+    }
+
+    double mb = (static_cast<double>(corpus.size()) * iterations) /
+                (1024.0 * 1024.0);
+
+    static const lex::multi_dfa::kernel kernels[] = {
+      lex::multi_dfa::kernel::scalar,
+      lex::multi_dfa::kernel::shuffle,
+      lex::multi_dfa::kernel::gather
+    };
+
+    for (lex::multi_dfa::kernel k : kernels) {
+      if (!multi.set_kernel(k)) {
+        continue;
+      }
+
+      bool agree = true;
+      t0 = lex::stats::now();
+
+      for (size_t it = 0; it < iterations; it++) {
+        for (size_t i = 0; i < corpus.lines().size(); i++) {
+          const std::string& line = corpus.lines()[i];
+
+          if (multi.scan(line.data(), line.size()) != masks[i]) {
+            agree = false;
+          }
+        }
+      }
+
+      double multi_time = lex::stats::now() - t0;
+
+      if (!agree) {
+        fprintf(stderr,
+                "multi_dfa/%zu: the %s kernel and is_match() disagree.\n",
+                n,
+                lex::multi_dfa::name(k));
+
+        return false;
+      }
+
+      printf("{\"family\": \"multi_dfa\", \"n\": %zu, "
+             "\"kernel\": \"%s\", \"corpus_bytes\": %zu, "
+             "\"matches\": %zu, \"separate_mb_s\": %.2f, "
+             "\"multi_mb_s\": %.2f}\n",
+             n,
+             lex::multi_dfa::name(k),
+             corpus.size(),
+             matches,
+             (separate_time > 0.0) ? mb / separate_time : 0.0,
+             (multi_time > 0.0) ? mb / multi_time : 0.0);
+
+      fflush(stdout);
+    }
+
+    return true;
+  }
+}
+
+static void usage(const char* program)
+{
+  fprintf(stderr, "Usage: %s [--quick] [--family <name>]\n", program);
+}
+
+int main(int argc, const char** argv)
+{
+  bool quick = false;
+  const char* family = nullptr;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0) {
+      quick = true;
+    } else if ((strcmp(argv[i], "--family") == 0) && (i + 1 < argc)) {
+      family = argv[++i];
+    } else {
+      usage(argv[0]);
+      return -1;
+    }
+  }
+
+  std::vector<benchmark> benchmarks;
+
+  static const size_t widths[] = {1, 4, 16};
+  static const size_t depths[] = {8, 32, 128};
+  static const size_t lengths[] = {4, 8, 12};
+  static const size_t words[] = {10, 100, 1000};
+  static const size_t automata[] = {4, 8, 16};
+
+  for (size_t n : widths) {
+    benchmarks.push_back(wide_class(n));
+  }
+
+  for (size_t n : depths) {
+    benchmarks.push_back(deep_nesting(n));
+  }
+
+  for (size_t n : lengths) {
+    benchmarks.push_back(blowup(n));
+  }
+
+  for (size_t n : words) {
+    benchmarks.push_back(literal_alternation(n));
+  }
+
+  size_t corpus_size = quick ? (64 * 1024) : (1024 * 1024);
+  size_t iterations = quick ? 1 : 3;
+
+  int ret = 0;
+
+  for (const benchmark& b : benchmarks) {
+    if ((!family) || (b.family == family)) {
+      if (!run(b, corpus_size, iterations)) {
+        ret = -1;
+      }
+    }
+  }
+
+  if ((!family) || (strcmp(family, "multi_dfa") == 0)) {
+    for (size_t n : automata) {
+      if (!run_multi(n, corpus_size, iterations)) {
+        ret = -1;
+      }
+    }
+  }
+
+  return ret;
+}
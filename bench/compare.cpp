@@ -0,0 +1,475 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <regex.h>
+#include <string>
+#include <vector>
+#include <regex>
+#include "lex/dfa.h"
+#include "lex/matcher.h"
+#include "bench/corpus.h"
+
+// Comparative benchmark: lex::dfa (with the quadratic forward search and with
+// the linear search of the reverse DFA) and lex::matcher (the engine chosen by
+// its planner) vs std::regex vs POSIX <regex.h>.
+//
+// Every pattern is compiled with the five engines, which must agree on the
+// leftmost-longest match of every line of the corpus (std::regex and POSIX
+// regcomp() use the extended grammar, which has leftmost-longest semantics).
+// Then the compile time, the heap usage after compilation and the matching
+// throughput are printed as JSON lines, one object per (pattern, engine).
+//
+// With --corpus-dir, the corpora are loaded from (or, the first time, saved
+// to) the given directory, so the same inputs can be reused across versions.
+
+namespace {
+  struct pattern {
+    const char* name;
+
+    // lex::regular_expression syntax.
+    const char* regex;
+
+    bench::corpus::alphabet alphabet;
+    std::vector<std::string> samples;
+  };
+
+  struct result {
+    bool found;
+    size_t start;
+    size_t end;
+  };
+
+  struct engine {
+    const char* name;
+
+    // Compile time (seconds).
+    double compile_time;
+
+    // Heap usage after compilation (bytes).
+    size_t memory;
+
+    // Matching time (seconds).
+    double match_time;
+
+    std::vector<result> results;
+  };
+
+  // Convert a lex::regular_expression pattern to POSIX extended syntax: the
+  // C escapes (\n, \t, ...) are replaced by the characters themselves (\b
+  // is a word boundary, not a backspace).
+  std::string to_posix(const char* regex)
+  {
+    std::string s;
+
+    for (; *regex; regex++) {
+      if ((*regex == '\\') && (regex[1])) {
+        switch (*++regex) {
+          case 'a':
+            s += '\a';
+            break;
+          case 'f':
+            s += '\f';
+            break;
+          case 'n':
+            s += '\n';
+            break;
+          case 'r':
+            s += '\r';
+            break;
+          case 't':
+            s += '\t';
+            break;
+          case 'v':
+            s += '\v';
+            break;
+          default:
+            s += '\\';
+            s += *regex;
+        }
+      } else {
+        s += *regex;
+      }
+    }
+
+    return s;
+  }
+
+  bool run_lex(const pattern& p, const bench::corpus& corpus, engine& e)
+  {
+    e.name = "lex::dfa";
+
+    size_t base = lex::stats::heap_in_use();
+    double t0 = lex::stats::now();
+
+    lex::regular_expression regex;
+    lex::dfa dfa;
+    if ((!regex.parse(p.regex)) || (!dfa.build(regex))) {
+      return false;
+    }
+
+    e.compile_time = lex::stats::now() - t0;
+    e.memory = lex::stats::heap_in_use() - base;
+
+    t0 = lex::stats::now();
+
+    for (const std::string& line : corpus.lines()) {
+      result r;
+      r.found = dfa.search(line.data(), line.size(), r.start, r.end);
+
+      e.results.push_back(r);
+    }
+
+    e.match_time = lex::stats::now() - t0;
+
+    return true;
+  }
+
+  bool run_lex_reverse(const pattern& p,
+                       const bench::corpus& corpus,
+                       engine& e)
+  {
+    e.name = "lex::dfa (reverse)";
+
+    size_t base = lex::stats::heap_in_use();
+    double t0 = lex::stats::now();
+
+    lex::regular_expression regex;
+    lex::dfa dfa;
+    lex::dfa reverse;
+    if ((!regex.parse(p.regex)) ||
+        (!dfa.build(regex)) ||
+        (!reverse.build_reverse(regex, true))) {
+      return false;
+    }
+
+    e.compile_time = lex::stats::now() - t0;
+    e.memory = lex::stats::heap_in_use() - base;
+
+    t0 = lex::stats::now();
+
+    for (const std::string& line : corpus.lines()) {
+      result r;
+      r.found = dfa.search(reverse, line.data(), line.size(), r.start, r.end);
+
+      e.results.push_back(r);
+    }
+
+    e.match_time = lex::stats::now() - t0;
+
+    return true;
+  }
+
+  bool run_matcher(const pattern& p, const bench::corpus& corpus, engine& e)
+  {
+    size_t base = lex::stats::heap_in_use();
+    double t0 = lex::stats::now();
+
+    lex::matcher m;
+    if (!m.compile(p.regex)) {
+      return false;
+    }
+
+    e.compile_time = lex::stats::now() - t0;
+    e.memory = lex::stats::heap_in_use() - base;
+
+    switch (m.used_engine()) {
+      case lex::matcher::engine::literal:
+        e.name = "lex::matcher (literal)";
+        break;
+      case lex::matcher::engine::bit_parallel:
+        e.name = "lex::matcher (bit-parallel)";
+        break;
+      case lex::matcher::engine::lazy_dfa:
+        e.name = "lex::matcher (lazy-dfa)";
+        break;
+      default:
+        e.name = "lex::matcher (dfa)";
+    }
+
+    t0 = lex::stats::now();
+
+    for (const std::string& line : corpus.lines()) {
+      result r;
+      r.found = m.search(line.data(), line.size(), r.start, r.end);
+
+      e.results.push_back(r);
+    }
+
+    e.match_time = lex::stats::now() - t0;
+
+    return true;
+  }
+
+  bool run_std(const pattern& p, const bench::corpus& corpus, engine& e)
+  {
+    e.name = "std::regex";
+
+    std::string s = to_posix(p.regex);
+
+    size_t base = lex::stats::heap_in_use();
+    double t0 = lex::stats::now();
+
+    std::regex regex;
+
+    try {
+      regex.assign(s, std::regex::extended);
+    } catch (const std::regex_error&) {
+      return false;
+    }
+
+    e.compile_time = lex::stats::now() - t0;
+    e.memory = lex::stats::heap_in_use() - base;
+
+    t0 = lex::stats::now();
+
+    for (const std::string& line : corpus.lines()) {
+      std::smatch m;
+
+      result r;
+      if ((r.found = std::regex_search(line, m, regex)) == true) {
+        r.start = m.position(0);
+        r.end = r.start + m.length(0);
+      }
+
+      e.results.push_back(r);
+    }
+
+    e.match_time = lex::stats::now() - t0;
+
+    return true;
+  }
+
+  bool run_posix(const pattern& p, const bench::corpus& corpus, engine& e)
+  {
+    e.name = "regcomp";
+
+    std::string s = to_posix(p.regex);
+
+    size_t base = lex::stats::heap_in_use();
+    double t0 = lex::stats::now();
+
+    regex_t regex;
+    if (regcomp(&regex, s.c_str(), REG_EXTENDED) != 0) {
+      return false;
+    }
+
+    e.compile_time = lex::stats::now() - t0;
+    e.memory = lex::stats::heap_in_use() - base;
+
+    t0 = lex::stats::now();
+
+    for (const std::string& line : corpus.lines()) {
+      regmatch_t m;
+
+      // The lines are not NUL-terminated: use REG_STARTEND.
+      m.rm_so = 0;
+      m.rm_eo = line.size();
+
+      result r;
+      if ((r.found = (regexec(&regex,
+                              line.data(),
+                              1,
+                              &m,
+                              REG_STARTEND) == 0)) == true) {
+        r.start = m.rm_so;
+        r.end = m.rm_eo;
+      }
+
+      e.results.push_back(r);
+    }
+
+    e.match_time = lex::stats::now() - t0;
+
+    regfree(&regex);
+
+    return true;
+  }
+
+  // Count the lines where the results of the two engines differ.
+  size_t disagreements(const engine& a, const engine& b)
+  {
+    size_t count = 0;
+
+    for (size_t i = 0; i < a.results.size(); i++) {
+      const result& ra = a.results[i];
+      const result& rb = b.results[i];
+
+      if ((ra.found != rb.found) ||
+          ((ra.found) && ((ra.start != rb.start) || (ra.end != rb.end)))) {
+        count++;
+      }
+    }
+
+    return count;
+  }
+
+  bool load_corpus(const pattern& p,
+                   const char* dir,
+                   size_t size,
+                   bench::corpus& corpus)
+  {
+    if (!dir) {
+      corpus.generate(p.alphabet, p.samples, size, strlen(p.name));
+      return true;
+    }
+
+    std::string filename = std::string(dir) + "/" + p.name + ".txt";
+
+    if (!corpus.load(filename.c_str())) {
+      corpus.generate(p.alphabet, p.samples, size, strlen(p.name));
+
+      if (!corpus.save(filename.c_str())) {
+        fprintf(stderr, "Error saving corpus '%s'.\n", filename.c_str());
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  std::vector<pattern> patterns()
+  {
+    std::vector<pattern> v;
+
+    v.push_back({"integer",
+                 "[0-9]+",
+                 bench::corpus::alphabet::printable,
+                 {"12345", "7"}});
+
+    v.push_back({"float",
+                 "[0-9]+\\.[0-9]*([Ee][+-]?[0-9]+)?",
+                 bench::corpus::alphabet::printable,
+                 {"123.e12", "3.14", "1.5E-7"}});
+
+    v.push_back({"email",
+                 "[a-z0-9._]+@[a-z]+\\.((com)|(org)|(net))",
+                 bench::corpus::alphabet::lowercase,
+                 {"john.doe@example.com", "x_y@mail.org"}});
+
+    v.push_back({"abb",
+                 "(a|b)*abb",
+                 bench::corpus::alphabet::ab,
+                 {"abb", "babb"}});
+
+    v.push_back({"blowup",
+                 "(a|b)*a(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)",
+                 bench::corpus::alphabet::ab,
+                 {"abbbbbb"}});
+
+    v.push_back({"blowup16",
+                 "(a|b)*a(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)"
+                 "(a|b)(a|b)(a|b)(a|b)(a|b)",
+                 bench::corpus::alphabet::ab,
+                 {"abbbbbbbbbbbbbbb"}});
+
+    v.push_back({"password",
+                 "password",
+                 bench::corpus::alphabet::lowercase,
+                 {"password"}});
+
+    v.push_back({"methods",
+                 "(GET)|(POST)|(PUT)|(DELETE)|(HEAD)|(OPTIONS)",
+                 bench::corpus::alphabet::printable,
+                 {"GET", "POST", "OPTIONS"}});
+
+    v.push_back({"any",
+                 "x.*y",
+                 bench::corpus::alphabet::lowercase,
+                 {"x--y"}});
+
+    v.push_back({"anchored",
+                 "^[a-z]+=[0-9]+",
+                 bench::corpus::alphabet::lowercase,
+                 {"key=42", "x=0"}});
+
+    return v;
+  }
+}
+
+static void usage(const char* program)
+{
+  fprintf(stderr,
+          "Usage: %s [--quick] [--corpus-dir <directory>]\n",
+          program);
+}
+
+int main(int argc, const char** argv)
+{
+  bool quick = false;
+  const char* dir = nullptr;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0) {
+      quick = true;
+    } else if ((strcmp(argv[i], "--corpus-dir") == 0) && (i + 1 < argc)) {
+      dir = argv[++i];
+    } else {
+      usage(argv[0]);
+      return -1;
+    }
+  }
+
+  size_t size = quick ? (64 * 1024) : (1024 * 1024);
+
+  int ret = 0;
+
+  for (const pattern& p : patterns()) {
+    bench::corpus corpus;
+    if (!load_corpus(p, dir, size, corpus)) {
+      return -1;
+    }
+
+    engine engines[5];
+    if ((!run_lex(p, corpus, engines[0])) ||
+        (!run_lex_reverse(p, corpus, engines[1])) ||
+        (!run_matcher(p, corpus, engines[2])) ||
+        (!run_std(p, corpus, engines[3])) ||
+        (!run_posix(p, corpus, engines[4]))) {
+      fprintf(stderr, "%s: error compiling '%s'.\n", p.name, p.regex);
+
+      ret = -1;
+      continue;
+    }
+
+    double mb = corpus.size() / (1024.0 * 1024.0);
+
+    for (const engine& e : engines) {
+      size_t diff = disagreements(engines[0], e);
+
+      size_t matches = 0;
+      for (const result& r : e.results) {
+        if (r.found) {
+          matches++;
+        }
+      }
+
+      printf("{\"pattern\": \"%s\", \"engine\": \"%s\", "
+             "\"compile_s\": %.6f, \"memory_bytes\": %zu, "
+             "\"corpus_bytes\": %zu, \"matches\": %zu, "
+             "\"disagreements\": %zu, \"throughput_mb_s\": %.2f}\n",
+             p.name,
+             e.name,
+             e.compile_time,
+             e.memory,
+             corpus.size(),
+             matches,
+             diff,
+             (e.match_time > 0.0) ? mb / e.match_time : 0.0);
+
+      if (diff > 0) {
+        fprintf(stderr,
+                "%s: %s and %s disagree on %zu line(s).\n",
+                p.name,
+                engines[0].name,
+                e.name,
+                diff);
+
+        ret = -1;
+      }
+    }
+
+    fflush(stdout);
+  }
+
+  return ret;
+}
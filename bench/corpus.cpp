@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include "bench/corpus.h"
+
+std::string bench::corpus::random::word(size_t minlen, size_t maxlen)
+{
+  std::string w;
+
+  size_t len = range(minlen, maxlen);
+  for (size_t i = 0; i < len; i++) {
+    w += static_cast<char>('a' + (next() % 26));
+  }
+
+  return w;
+}
+
+void bench::corpus::generate(alphabet a,
+                             const std::vector<std::string>& samples,
+                             size_t size,
+                             uint64_t seed)
+{
+  random rnd(seed);
+
+  _M_lines.clear();
+  _M_size = 0;
+
+  while (_M_size < size) {
+    std::string line;
+    size_t len = rnd.range(32, 96);
+
+    // One line out of eight contains a sample.
+    size_t planted = ((!samples.empty()) && (rnd.next() % 8 == 0)) ?
+                       rnd.range(0, len) :
+                       len + 1;
+
+    while (line.size() < len) {
+      if (line.size() >= planted) {
+        line += samples[rnd.next() % samples.size()];
+        planted = len + 1;
+      }
+
+      switch (a) {
+        case alphabet::ab:
+          line += static_cast<char>('a' + (rnd.next() % 3));
+          break;
+        case alphabet::lowercase:
+          line += rnd.word(2, 9);
+          line += ' ';
+          break;
+        case alphabet::printable:
+          line += static_cast<char>(' ' + (rnd.next() % 95));
+          break;
+      }
+    }
+
+    _M_size += line.size();
+    _M_lines.push_back(line);
+  }
+}
+
+bool bench::corpus::load(const char* filename)
+{
+  FILE* file;
+  if ((file = fopen(filename, "rb")) == nullptr) {
+    return false;
+  }
+
+  _M_lines.clear();
+  _M_size = 0;
+
+  std::string line;
+
+  int c;
+  while ((c = fgetc(file)) != EOF) {
+    if (c != '\n') {
+      line += static_cast<char>(c);
+    } else {
+      _M_size += line.size();
+      _M_lines.push_back(line);
+
+      line.clear();
+    }
+  }
+
+  if (!line.empty()) {
+    _M_size += line.size();
+    _M_lines.push_back(line);
+  }
+
+  bool ret = (ferror(file) == 0);
+
+  fclose(file);
+
+  return ret;
+}
+
+bool bench::corpus::save(const char* filename) const
+{
+  FILE* file;
+  if ((file = fopen(filename, "wb")) == nullptr) {
+    return false;
+  }
+
+  for (const std::string& line : _M_lines) {
+    fwrite(line.data(), 1, line.size(), file);
+    fputc('\n', file);
+  }
+
+  bool ret = (ferror(file) == 0);
+
+  return ((fclose(file) == 0) && (ret));
+}
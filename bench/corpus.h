@@ -0,0 +1,104 @@
+#ifndef BENCH_CORPUS_H
+#define BENCH_CORPUS_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace bench {
+  // Generated input corpus: a list of lines, some of them containing one of
+  // the given samples. The generation is deterministic (it only depends on
+  // the arguments), and the corpus can be saved to / loaded from a file so the
+  // same input can be reused across versions.
+  class corpus {
+    public:
+      enum class alphabet {
+        ab, // 'a', 'b' and 'c'.
+        lowercase, // Lowercase words separated by spaces.
+        printable // Printable ASCII.
+      };
+
+      // Pseudo-random number generator (xorshift64*).
+      class random {
+        public:
+          // Constructor.
+          random(uint64_t seed);
+
+          // Get next number.
+          uint64_t next();
+
+          // Get number in the range [min, max].
+          size_t range(size_t min, size_t max);
+
+          // Get random lowercase word.
+          std::string word(size_t minlen, size_t maxlen);
+
+        private:
+          uint64_t _M_state;
+      };
+
+      // Constructor.
+      corpus();
+
+      // Generate corpus of approximately 'size' bytes.
+      void generate(alphabet a,
+                    const std::vector<std::string>& samples,
+                    size_t size,
+                    uint64_t seed);
+
+      // Load corpus from file (one line per input).
+      bool load(const char* filename);
+
+      // Save corpus to file.
+      bool save(const char* filename) const;
+
+      // Get lines.
+      const std::vector<std::string>& lines() const;
+
+      // Get size in bytes (not counting the line separators).
+      size_t size() const;
+
+    private:
+      std::vector<std::string> _M_lines;
+      size_t _M_size;
+  };
+
+  inline corpus::random::random(uint64_t seed)
+    : _M_state(seed ^ 0x9e3779b97f4a7c15ull)
+  {
+    if (_M_state == 0) {
+      _M_state = 0x9e3779b97f4a7c15ull;
+    }
+  }
+
+  inline uint64_t corpus::random::next()
+  {
+    _M_state ^= _M_state >> 12;
+    _M_state ^= _M_state << 25;
+    _M_state ^= _M_state >> 27;
+
+    return _M_state * 0x2545f4914f6cdd1dull;
+  }
+
+  inline size_t corpus::random::range(size_t min, size_t max)
+  {
+    return min + (next() % (max - min + 1));
+  }
+
+  inline corpus::corpus()
+    : _M_size(0)
+  {
+  }
+
+  inline const std::vector<std::string>& corpus::lines() const
+  {
+    return _M_lines;
+  }
+
+  inline size_t corpus::size() const
+  {
+    return _M_size;
+  }
+}
+
+#endif // BENCH_CORPUS_H
@@ -0,0 +1,83 @@
+#include <string.h>
+#include "lex/arena.h"
+#include "macros/macros.h"
+
+void* lex::arena::reallocate(void* ptr,
+                             size_t oldsize,
+                             size_t newsize,
+                             size_t alignment)
+{
+  if (!ptr) {
+    return allocate(newsize, alignment);
+  }
+
+  // If 'ptr' is the last allocation and it fits in the current chunk...
+  if ((ptr == _M_last) && (_M_last + newsize <= _M_end)) {
+    _M_top = _M_last + newsize;
+    return ptr;
+  }
+
+  void* p;
+  if ((p = allocate(newsize, alignment)) != nullptr) {
+    memcpy(p, ptr, MIN(oldsize, newsize));
+  }
+
+  return p;
+}
+
+void lex::arena::clear()
+{
+  while (_M_chunks) {
+    chunk* next = _M_chunks->next;
+    free(_M_chunks);
+    _M_chunks = next;
+  }
+
+  _M_top = nullptr;
+  _M_end = nullptr;
+  _M_last = nullptr;
+
+  _M_size = 0;
+}
+
+void lex::arena::reset()
+{
+  if (!_M_chunks) {
+    return;
+  }
+
+  while (_M_chunks->next) {
+    chunk* next = _M_chunks->next->next;
+    free(_M_chunks->next);
+    _M_chunks->next = next;
+  }
+
+  _M_top = reinterpret_cast<uint8_t*>(_M_chunks + 1);
+  _M_end = reinterpret_cast<uint8_t*>(_M_chunks) + _M_chunks->size;
+  _M_last = nullptr;
+
+  _M_size = _M_chunks->size;
+}
+
+bool lex::arena::allocate_chunk(size_t size)
+{
+  size = MAX(size, _M_chunk_size) + sizeof(chunk);
+
+  chunk* c;
+  if ((c = static_cast<chunk*>(malloc(size))) != nullptr) {
+    c->next = _M_chunks;
+    c->size = size;
+
+    _M_chunks = c;
+
+    _M_top = reinterpret_cast<uint8_t*>(c + 1);
+    _M_end = reinterpret_cast<uint8_t*>(c) + size;
+    _M_last = nullptr;
+
+    _M_size += size;
+
+    return true;
+  }
+
+  return false;
+}
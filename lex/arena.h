@@ -0,0 +1,144 @@
+#ifndef LEX_ARENA_H
+#define LEX_ARENA_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <cstddef>
+#include <new>
+#include <utility>
+
+namespace lex {
+  // Bump allocator: memory is carved out of large chunks and it is only
+  // released all at once (by clear() or by the destructor), without calling
+  // the destructors of the objects.
+  class arena {
+    public:
+      static const size_t default_chunk_size = 64 * 1024;
+
+      // Constructor.
+      arena(size_t chunk_size = default_chunk_size);
+
+      // Destructor.
+      ~arena();
+
+      // Allocate.
+      void* allocate(size_t size,
+                     size_t alignment = alignof(std::max_align_t));
+
+      // Reallocate: if 'ptr' is the last allocation and there is room in the
+      // current chunk, it is grown in place.
+      void* reallocate(void* ptr,
+                       size_t oldsize,
+                       size_t newsize,
+                       size_t alignment = alignof(std::max_align_t));
+
+      // Create object.
+      template<typename T, typename... Args>
+      T* create(Args&&... args);
+
+      // Create array of objects.
+      template<typename T, typename... Args>
+      T* create_array(size_t count, Args&&... args);
+
+      // Release all the memory.
+      void clear();
+
+      // Release all the memory but the most recent chunk, which is kept to
+      // serve the next allocations.
+      void reset();
+
+      // Get number of bytes allocated from the system.
+      size_t size() const;
+
+    private:
+      struct chunk {
+        chunk* next;
+        size_t size;
+      };
+
+      chunk* _M_chunks;
+
+      uint8_t* _M_top;
+      uint8_t* _M_end;
+
+      // Last allocation.
+      uint8_t* _M_last;
+
+      size_t _M_chunk_size;
+      size_t _M_size;
+
+      // Allocate new chunk.
+      bool allocate_chunk(size_t size);
+
+      // Disable copy constructor and assignment operator.
+      arena(const arena&) = delete;
+      arena& operator=(const arena&) = delete;
+  };
+
+  inline arena::arena(size_t chunk_size)
+    : _M_chunks(nullptr),
+      _M_top(nullptr),
+      _M_end(nullptr),
+      _M_last(nullptr),
+      _M_chunk_size(chunk_size),
+      _M_size(0)
+  {
+  }
+
+  inline arena::~arena()
+  {
+    clear();
+  }
+
+  inline void* arena::allocate(size_t size, size_t alignment)
+  {
+    uintptr_t top = reinterpret_cast<uintptr_t>(_M_top);
+    top = (top + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+
+    if ((!_M_top) || (top + size > reinterpret_cast<uintptr_t>(_M_end))) {
+      if (!allocate_chunk(size + alignment)) {
+        return nullptr;
+      }
+
+      top = reinterpret_cast<uintptr_t>(_M_top);
+      top = (top + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+    }
+
+    _M_last = reinterpret_cast<uint8_t*>(top);
+    _M_top = _M_last + size;
+
+    return _M_last;
+  }
+
+  template<typename T, typename... Args>
+  inline T* arena::create(Args&&... args)
+  {
+    void* p;
+    if ((p = allocate(sizeof(T), alignof(T))) != nullptr) {
+      return new (p) T(std::forward<Args>(args)...);
+    }
+
+    return nullptr;
+  }
+
+  template<typename T, typename... Args>
+  inline T* arena::create_array(size_t count, Args&&... args)
+  {
+    T* p;
+    if ((p = static_cast<T*>(allocate(count * sizeof(T), alignof(T)))) !=
+        nullptr) {
+      for (size_t i = 0; i < count; i++) {
+        new (p + i) T(std::forward<Args>(args)...);
+      }
+    }
+
+    return p;
+  }
+
+  inline size_t arena::size() const
+  {
+    return _M_size;
+  }
+}
+
+#endif // LEX_ARENA_H
@@ -0,0 +1,101 @@
+#include <atomic>
+#include <system_error>
+#include <thread>
+#include "lex/batch_compiler.h"
+#include "macros/macros.h"
+
+size_t lex::batch_compiler::compile(const std::vector<std::string>& patterns,
+                                    std::vector<result>& results) const
+{
+  results.clear();
+  results.resize(patterns.size());
+
+  size_t nthreads = MIN(number_threads(), patterns.size());
+
+  // The workers take the patterns in order; each one writes the result of a
+  // pattern at its index, so the results don't depend on the number of
+  // threads.
+  std::atomic<size_t> next(0);
+  std::atomic<size_t> compiled(0);
+
+  auto worker = [&]() {
+    regular_expression regex;
+    regex.set_flags(_M_flags);
+    regex.set_expansion_limit(_M_expansion_limit);
+
+    size_t count = 0;
+
+    size_t idx;
+    while ((idx = next++) < patterns.size()) {
+      if (compile(patterns[idx], regex, results[idx])) {
+        count++;
+      }
+
+      regex.clear();
+    }
+
+    compiled += count;
+  };
+
+  std::vector<std::thread> threads;
+
+  try {
+    for (size_t t = 1; t < nthreads; t++) {
+      threads.emplace_back(worker);
+    }
+  } catch (const std::system_error&) {
+    // Continue with the threads which could be created.
+  }
+
+  worker();
+
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  return compiled;
+}
+
+size_t lex::batch_compiler::number_threads() const
+{
+  if (_M_nthreads > 0) {
+    return _M_nthreads;
+  }
+
+  return MAX(std::thread::hardware_concurrency(), 1u);
+}
+
+bool lex::batch_compiler::compile(const std::string& pattern,
+                                  regular_expression& regex,
+                                  result& res) const
+{
+  // The patterns are NUL-terminated strings.
+  if (pattern.find('\0') != std::string::npos) {
+    res.error = "Invalid character in regular expression";
+    return false;
+  }
+
+  if (!regex.parse(pattern.c_str())) {
+    res.error = "Error parsing regular expression";
+    return false;
+  }
+
+  dfa builder;
+  if (!builder.build(regex)) {
+    res.error = "Error building DFA";
+    return false;
+  }
+
+  std::unique_ptr<compiled_dfa> d(new (std::nothrow) compiled_dfa());
+  if (!d) {
+    res.error = "Out of memory";
+    return false;
+  }
+
+  *d = builder.freeze();
+
+  res.d = std::move(d);
+  res.error = nullptr;
+
+  return true;
+}
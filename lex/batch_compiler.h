@@ -0,0 +1,79 @@
+#ifndef LEX_BATCH_COMPILER_H
+#define LEX_BATCH_COMPILER_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "lex/dfa.h"
+
+namespace lex {
+  // Compiles independent regular expressions concurrently: the patterns are
+  // distributed among a pool of threads, each of which reuses its own
+  // regular expression (and the arena of its syntax tree) for all the
+  // patterns it compiles.
+  class batch_compiler {
+    public:
+      // Result of the compilation of a pattern.
+      struct result {
+        // Compiled DFA (null if the pattern could not be compiled).
+        std::unique_ptr<compiled_dfa> d;
+
+        // Error message (null if the pattern has been compiled).
+        const char* error;
+      };
+
+      // Constructor.
+      batch_compiler();
+
+      // Set the number of threads (0: one per hardware thread).
+      void set_threads(size_t nthreads);
+
+      // Set the flags of the regular expressions.
+      void set_flags(unsigned flags);
+
+      // Set the expansion limit of the regular expressions.
+      void set_expansion_limit(size_t limit);
+
+      // Compile the patterns: results[i] is the result of patterns[i].
+      // Returns the number of patterns which have been compiled.
+      size_t compile(const std::vector<std::string>& patterns,
+                     std::vector<result>& results) const;
+
+    private:
+      size_t _M_nthreads;
+      unsigned _M_flags;
+      size_t _M_expansion_limit;
+
+      // Get the number of threads.
+      size_t number_threads() const;
+
+      // Compile pattern.
+      bool compile(const std::string& pattern,
+                   regular_expression& regex,
+                   result& res) const;
+  };
+
+  inline batch_compiler::batch_compiler()
+    : _M_nthreads(0),
+      _M_flags(0),
+      _M_expansion_limit(regular_expression::default_expansion_limit)
+  {
+  }
+
+  inline void batch_compiler::set_threads(size_t nthreads)
+  {
+    _M_nthreads = nthreads;
+  }
+
+  inline void batch_compiler::set_flags(unsigned flags)
+  {
+    _M_flags = flags;
+  }
+
+  inline void batch_compiler::set_expansion_limit(size_t limit)
+  {
+    _M_expansion_limit = limit;
+  }
+}
+
+#endif // LEX_BATCH_COMPILER_H
@@ -0,0 +1,211 @@
+#include <string.h>
+#include "lex/bit_parallel.h"
+
+const size_t lex::bit_parallel::max_positions;
+const size_t lex::bit_parallel::nchunks;
+
+bool lex::bit_parallel::build(const regular_expression& regex)
+{
+  return construct(regex, false);
+}
+
+bool lex::bit_parallel::build_reverse(const regular_expression& regex)
+{
+  return construct(regex, true);
+}
+
+bool lex::bit_parallel::construct(const regular_expression& regex,
+                                  bool reverse)
+{
+  const node* root;
+  if (((root = regex.root()) == nullptr) ||
+      (regex.has_assertions()) ||
+      (regex.number_positions() > max_positions)) {
+    return false;
+  }
+
+  // Positions which match each byte.
+  memset(_M_bytes, 0, sizeof(_M_bytes));
+
+  for (size_t i = 0; i < regex.number_symbols(); i++) {
+    const positions& p = regex.get_positions(i);
+
+    for (size_t j = 0; j < p.size(); j++) {
+      _M_bytes[regex.get_symbol(i)] |= static_cast<uint64_t>(1) << p.get(j);
+    }
+  }
+
+  // followpos of each position.
+  uint64_t follow[max_positions];
+  memset(follow, 0, sizeof(follow));
+
+  for (size_t i = 0; i < regex.number_nodes(); i++) {
+    const node* n = regex.get_node(i);
+
+    const node* from;
+    const node* to;
+
+    switch (n->t) {
+      case node::type::concatenation:
+        from = n->left;
+        to = n->right;
+        break;
+      case node::type::repetition_zero_or_more:
+      case node::type::repetition_one_or_more:
+        from = n->left;
+        to = n->left;
+        break;
+      default:
+        continue;
+    }
+
+    uint64_t first = 0;
+    for (size_t j = 0; j < to->firstpos.size(); j++) {
+      first |= static_cast<uint64_t>(1) << to->firstpos.get(j);
+    }
+
+    for (size_t j = 0; j < from->lastpos.size(); j++) {
+      follow[from->lastpos.get(j)] |= first;
+    }
+  }
+
+  uint64_t initial = 0;
+  for (size_t j = 0; j < root->firstpos.size(); j++) {
+    initial |= static_cast<uint64_t>(1) << root->firstpos.get(j);
+  }
+
+  position endmark = regex.number_positions() - 1;
+
+  _M_first = initial;
+  _M_endmark = static_cast<uint64_t>(1) << endmark;
+
+  if (reverse) {
+    // Invert followpos (the beginning precedes firstpos(root)).
+    uint64_t inverse[max_positions];
+    memset(inverse, 0, sizeof(inverse));
+
+    for (size_t p = 0; p < regex.number_positions(); p++) {
+      for (uint64_t m = follow[p]; m != 0; m &= m - 1) {
+        inverse[__builtin_ctzll(m)] |= static_cast<uint64_t>(1) << p;
+      }
+    }
+
+    for (uint64_t m = initial; m != 0; m &= m - 1) {
+      inverse[__builtin_ctzll(m)] |= _M_endmark;
+    }
+
+    _M_first = inverse[endmark];
+
+    memcpy(follow, inverse, sizeof(follow));
+  }
+
+  // Tables of unions (each mask adds its lowest position to the mask
+  // without it).
+  _M_nchunks = (regex.number_positions() + 7) / 8;
+
+  for (size_t k = 0; k < _M_nchunks; k++) {
+    _M_follow[k][0] = 0;
+
+    for (size_t m = 1; m < 256; m++) {
+      _M_follow[k][m] = _M_follow[k][m & (m - 1)] |
+                        follow[(8 * k) + __builtin_ctz(m)];
+    }
+  }
+
+  return true;
+}
+
+bool lex::bit_parallel::match(const void* buf, size_t len) const
+{
+  const uint8_t* b = static_cast<const uint8_t*>(buf);
+
+  uint64_t s = _M_first;
+
+  for (size_t i = 0; (i < len) && (s != 0); i++) {
+    s = next(s, b[i]);
+  }
+
+  return ((s & _M_endmark) != 0);
+}
+
+bool lex::bit_parallel::search(const void* buf,
+                               size_t len,
+                               size_t& start,
+                               size_t& end) const
+{
+  const uint8_t* b = static_cast<const uint8_t*>(buf);
+
+  for (size_t i = 0; i <= len; i++) {
+    uint64_t s = _M_first;
+
+    bool found;
+    if ((found = ((s & _M_endmark) != 0)) == true) {
+      end = i;
+    }
+
+    for (size_t j = i; j < len; j++) {
+      if ((s = next(s, b[j])) == 0) {
+        break;
+      }
+
+      if (s & _M_endmark) {
+        found = true;
+        end = j + 1;
+      }
+    }
+
+    if (found) {
+      start = i;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool lex::bit_parallel::search(const bit_parallel& reverse,
+                               const void* buf,
+                               size_t len,
+                               size_t& start,
+                               size_t& end) const
+{
+  const uint8_t* b = static_cast<const uint8_t*>(buf);
+
+  // Backward scan (restarting at every byte): leftmost start.
+  uint64_t s = reverse._M_first;
+
+  bool found;
+  if ((found = ((s & reverse._M_endmark) != 0)) == true) {
+    start = len;
+  }
+
+  for (size_t i = len; i-- > 0; ) {
+    if ((s = reverse.next(s, b[i]) | reverse._M_first) & reverse._M_endmark) {
+      start = i;
+      found = true;
+    }
+  }
+
+  if (!found) {
+    return false;
+  }
+
+  // Forward scan from the leftmost start: longest match.
+  s = _M_first;
+
+  if (s & _M_endmark) {
+    end = start;
+  }
+
+  for (size_t i = start; i < len; i++) {
+    if ((s = next(s, b[i])) == 0) {
+      break;
+    }
+
+    if (s & _M_endmark) {
+      end = i + 1;
+    }
+  }
+
+  return true;
+}
@@ -0,0 +1,100 @@
+#ifndef LEX_BIT_PARALLEL_H
+#define LEX_BIT_PARALLEL_H
+
+#include <stdint.h>
+#include "lex/regular_expression.h"
+
+namespace lex {
+  // Bit-parallel simulation of a regular expression with at most 64
+  // positions (the endmark included), without building its DFA.
+  //
+  // The current state is the bit mask of the positions which can match the
+  // next byte (the set of positions of the DFA state, computed on the fly).
+  // Reading the byte c keeps the positions which match c and replaces them
+  // by the union of their followpos sets, which is looked up 8 positions at
+  // a time.
+  class bit_parallel {
+    public:
+      // Maximum number of positions.
+      static const size_t max_positions = 64;
+
+      // Constructor.
+      bit_parallel();
+
+      // Build from a regular expression (without assertions).
+      bool build(const regular_expression& regex);
+
+      // Build the reverse simulation: followpos is inverted and the bit of
+      // the endmark stands for the beginning of the regular expression (the
+      // endmark never matches a byte). Scanning the input backward and
+      // restarting at every byte (see search(reverse, ...)), the state
+      // contains that bit after reading the byte at offset i iff a match
+      // starts at i.
+      bool build_reverse(const regular_expression& regex);
+
+      // Does the whole input match?
+      bool match(const void* buf, size_t len) const;
+
+      // Search the leftmost-longest match (see compiled_dfa::search()).
+      bool search(const void* buf,
+                  size_t len,
+                  size_t& start,
+                  size_t& end) const;
+
+      // Search the leftmost-longest match in linear time, with the reverse
+      // simulation of the same regular expression (see
+      // compiled_dfa::search(reverse, ...)).
+      bool search(const bit_parallel& reverse,
+                  const void* buf,
+                  size_t len,
+                  size_t& start,
+                  size_t& end) const;
+
+    private:
+      static const size_t nchunks = max_positions / 8;
+
+      // Positions which match each byte.
+      uint64_t _M_bytes[256];
+
+      // _M_follow[k][m]: union of the followpos sets of the positions of the
+      // mask m << (8 * k).
+      uint64_t _M_follow[nchunks][256];
+
+      // Number of chunks of 8 positions in use.
+      size_t _M_nchunks;
+
+      // firstpos(root) (in the reverse simulation, the positions followed
+      // by the endmark).
+      uint64_t _M_first;
+
+      // Endmark (in the reverse simulation, the beginning).
+      uint64_t _M_endmark;
+
+      // Build from a regular expression.
+      bool construct(const regular_expression& regex, bool reverse);
+
+      // Get next state.
+      uint64_t next(uint64_t s, uint8_t c) const;
+  };
+
+  inline bit_parallel::bit_parallel()
+    : _M_nchunks(0),
+      _M_first(0),
+      _M_endmark(0)
+  {
+  }
+
+  inline uint64_t bit_parallel::next(uint64_t s, uint8_t c) const
+  {
+    uint64_t t = s & _M_bytes[c];
+    uint64_t n = 0;
+
+    for (size_t k = 0; k < _M_nchunks; k++) {
+      n |= _M_follow[k][(t >> (8 * k)) & 0xff];
+    }
+
+    return n;
+  }
+}
+
+#endif // LEX_BIT_PARALLEL_H
@@ -0,0 +1,47 @@
+#ifndef LEX_CASE_FOLDING_H
+#define LEX_CASE_FOLDING_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+namespace lex {
+  // Simple case folding: the code points which are equivalent when case is
+  // ignored form orbits (e.g. k -> U+212A KELVIN SIGN -> K -> k), which are
+  // traversed with next().
+  class case_folding {
+    public:
+      // Largest number of code points of an orbit.
+      static const size_t max_orbit = 4;
+
+      // Get the next code point of the orbit of 'c' ('c' if it has no other
+      // case).
+      static uint32_t next(uint32_t c);
+
+      // Get the first code point >= 'c' which has other cases (UINT32_MAX
+      // if none).
+      static uint32_t next_foldable(uint32_t c);
+
+      // Check the table: for every code point 'c', next() must return to
+      // 'c' in at most max_orbit steps. Returns the first code point whose
+      // orbit is broken, or UINT32_MAX.
+      static uint32_t check();
+
+    private:
+      // The code points of [first, last] are mapped to c + delta, except
+      // for the delta values even_odd (even -> c + 1, odd -> c - 1) and
+      // odd_even (odd -> c + 1, even -> c - 1).
+      struct range {
+        uint32_t first;
+        uint32_t last;
+        int32_t delta;
+      };
+
+      static const int32_t even_odd = 1;
+      static const int32_t odd_even = -1;
+
+      static const range _M_ranges[];
+      static const size_t _M_nranges;
+  };
+}
+
+#endif // LEX_CASE_FOLDING_H
@@ -0,0 +1,174 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "lex/compile_cache.h"
+#include "lex/dfa.h"
+
+const char lex::compile_cache::magic[8] = {'L', 'E', 'X', 'C', 'A', 'C', 'H',
+                                           'E'};
+
+bool lex::compile_cache::compile(const char* regex,
+                                 unsigned flags,
+                                 compiled_dfa& d,
+                                 bool* hit) const
+{
+  size_t len = strlen(regex);
+
+  std::string fname = filename(regex, len, flags);
+
+  if (load(fname.c_str(), regex, len, flags, d)) {
+    if (hit) {
+      *hit = true;
+    }
+
+    return true;
+  }
+
+  if (hit) {
+    *hit = false;
+  }
+
+  // The entry doesn't exist or it is not valid: build the DFA.
+  regular_expression r;
+  r.set_flags(flags);
+
+  dfa builder;
+  if ((!r.parse(regex)) || (!builder.build(r))) {
+    return false;
+  }
+
+  d = builder.freeze();
+
+  // The cache is only an optimization: errors saving the entry are ignored.
+  save(fname.c_str(), regex, len, flags, d);
+
+  return true;
+}
+
+std::string lex::compile_cache::filename(const char* regex,
+                                         size_t len,
+                                         unsigned flags) const
+{
+  // FNV-1a of the format version, the flags and the regular expression.
+  uint64_t h = 0xcbf29ce484222325ull;
+
+  uint32_t words[2] = {compiled_dfa::format_version, flags};
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(words);
+  for (size_t i = 0; i < sizeof(words); i++) {
+    h = (h ^ bytes[i]) * 0x100000001b3ull;
+  }
+
+  for (size_t i = 0; i < len; i++) {
+    h = (h ^ static_cast<uint8_t>(regex[i])) * 0x100000001b3ull;
+  }
+
+  char name[32];
+  snprintf(name,
+           sizeof(name),
+           "/%016llx.dfa",
+           static_cast<unsigned long long>(h));
+
+  return _M_directory + name;
+}
+
+bool lex::compile_cache::load(const char* filename,
+                              const char* regex,
+                              size_t len,
+                              unsigned flags,
+                              compiled_dfa& d)
+{
+  int fd;
+  if ((fd = open(filename, O_RDONLY)) < 0) {
+    return false;
+  }
+
+  struct stat sbuf;
+  void* mapping;
+  if ((fstat(fd, &sbuf) < 0) ||
+      (static_cast<size_t>(sbuf.st_size) < image_offset(len)) ||
+      ((mapping = mmap(nullptr,
+                       sbuf.st_size,
+                       PROT_READ,
+                       MAP_PRIVATE,
+                       fd,
+                       0)) == MAP_FAILED)) {
+    close(fd);
+    return false;
+  }
+
+  close(fd);
+
+  size_t size = sbuf.st_size;
+
+  // Check the header and the regular expression (in case of a collision of
+  // the hashes).
+  const entry_header* header = static_cast<const entry_header*>(mapping);
+  if ((memcmp(header->magic, magic, sizeof(magic)) == 0) &&
+      (header->version == compiled_dfa::format_version) &&
+      (header->flags == flags) &&
+      (header->length == len) &&
+      (memcmp(header + 1, regex, len) == 0) &&
+      (d.load(mapping, size, image_offset(len)))) {
+    return true;
+  }
+
+  munmap(mapping, size);
+
+  return false;
+}
+
+bool lex::compile_cache::save(const char* filename,
+                              const char* regex,
+                              size_t len,
+                              unsigned flags,
+                              const compiled_dfa& d) const
+{
+  // Write a temporary file in the same directory and rename it, so the
+  // readers see either the old entry or the new one.
+  std::string tmp = _M_directory + "/.entry.XXXXXX";
+
+  int fd;
+  if ((fd = mkstemp(&tmp[0])) < 0) {
+    return false;
+  }
+
+  FILE* file;
+  if ((file = fdopen(fd, "wb")) == nullptr) {
+    close(fd);
+    unlink(tmp.c_str());
+
+    return false;
+  }
+
+  entry_header header;
+  memset(&header, 0, sizeof(entry_header));
+
+  memcpy(header.magic, magic, sizeof(magic));
+  header.version = compiled_dfa::format_version;
+  header.flags = flags;
+  header.length = len;
+
+  static const uint8_t padding[8] = {0};
+  size_t npadding = image_offset(len) - sizeof(entry_header) - len;
+
+  bool ret = ((fwrite(&header, sizeof(entry_header), 1, file) == 1) &&
+              (fwrite(regex, 1, len, file) == len) &&
+              (fwrite(padding, 1, npadding, file) == npadding) &&
+              (d.save(file)) &&
+              (fflush(file) == 0) &&
+              (fsync(fileno(file)) == 0));
+
+  if ((fclose(file) == 0) &&
+      (ret) &&
+      (rename(tmp.c_str(), filename) == 0)) {
+    return true;
+  }
+
+  unlink(tmp.c_str());
+
+  return false;
+}
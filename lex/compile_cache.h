@@ -0,0 +1,74 @@
+#ifndef LEX_COMPILE_CACHE_H
+#define LEX_COMPILE_CACHE_H
+
+#include <string>
+#include "lex/compiled_dfa.h"
+
+namespace lex {
+  // On-disk cache of frozen DFAs. The entries are files of a directory named
+  // after a hash of the regular expression, its flags and the format
+  // version; they are written atomically (to a temporary file which is then
+  // renamed) and loaded back with mmap(), without copying the transition
+  // table. Stale or corrupt entries are rebuilt.
+  class compile_cache {
+    public:
+      // Constructor.
+      compile_cache(const char* directory);
+
+      // Compile the regular expression into 'd'. If the cache has a valid
+      // entry for it, the DFA is loaded from the entry (the regular
+      // expression is neither parsed nor converted); otherwise, the DFA is
+      // built and saved in the cache. If 'hit' is not null, it is set to
+      // whether the DFA has been loaded from the cache.
+      bool compile(const char* regex,
+                   unsigned flags,
+                   compiled_dfa& d,
+                   bool* hit = nullptr) const;
+
+    private:
+      // Header of the entries. It is followed by the regular expression
+      // (padded to a multiple of 8 bytes) and the image of the DFA.
+      struct entry_header {
+        char magic[8];
+        uint32_t version;
+        uint32_t flags;
+        uint64_t length;
+      };
+
+      static const char magic[8];
+
+      std::string _M_directory;
+
+      // Get the filename of the entry of a regular expression.
+      std::string filename(const char* regex, size_t len, unsigned flags) const;
+
+      // Load entry.
+      static bool load(const char* filename,
+                       const char* regex,
+                       size_t len,
+                       unsigned flags,
+                       compiled_dfa& d);
+
+      // Save entry.
+      bool save(const char* filename,
+                const char* regex,
+                size_t len,
+                unsigned flags,
+                const compiled_dfa& d) const;
+
+      // Get the offset of the image of the DFA in an entry.
+      static size_t image_offset(size_t len);
+  };
+
+  inline compile_cache::compile_cache(const char* directory)
+    : _M_directory(directory)
+  {
+  }
+
+  inline size_t compile_cache::image_offset(size_t len)
+  {
+    return sizeof(entry_header) + ((len + 7) & ~static_cast<size_t>(7));
+  }
+}
+
+#endif // LEX_COMPILE_CACHE_H
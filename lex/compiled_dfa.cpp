@@ -0,0 +1,710 @@
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/mman.h>
+#include "lex/compiled_dfa.h"
+#include "macros/macros.h"
+
+const lex::state_id lex::compiled_dfa::dead_state;
+
+lex::compiled_dfa::compiled_dfa(compiled_dfa&& other)
+  : _M_nclasses(other._M_nclasses),
+    _M_dtran(other._M_dtran),
+    _M_nstates(other._M_nstates),
+    _M_start(other._M_start),
+    _M_first_accepting(other._M_first_accepting),
+    _M_first_always_accepting(other._M_first_always_accepting),
+    _M_unanchored(other._M_unanchored),
+    _M_accept(other._M_accept),
+    _M_mapping(other._M_mapping),
+    _M_mapping_size(other._M_mapping_size)
+{
+  memcpy(_M_classes, other._M_classes, sizeof(_M_classes));
+  memcpy(_M_starts, other._M_starts, sizeof(_M_starts));
+
+  other.reset();
+}
+
+lex::compiled_dfa& lex::compiled_dfa::operator=(compiled_dfa&& other)
+{
+  if (this != &other) {
+    release_table();
+
+    memcpy(_M_classes, other._M_classes, sizeof(_M_classes));
+    _M_nclasses = other._M_nclasses;
+
+    _M_dtran = other._M_dtran;
+    _M_nstates = other._M_nstates;
+
+    _M_start = other._M_start;
+    _M_first_accepting = other._M_first_accepting;
+    _M_first_always_accepting = other._M_first_always_accepting;
+    _M_unanchored = other._M_unanchored;
+
+    _M_accept = other._M_accept;
+    memcpy(_M_starts, other._M_starts, sizeof(_M_starts));
+
+    _M_mapping = other._M_mapping;
+    _M_mapping_size = other._M_mapping_size;
+
+    other.reset();
+  }
+
+  return *this;
+}
+
+bool lex::compiled_dfa::save(FILE* file) const
+{
+  if (_M_nstates == 0) {
+    return false;
+  }
+
+  image_header header;
+  memset(&header, 0, sizeof(image_header));
+
+  header.magic = image_magic;
+  header.version = format_version;
+  header.nstates = _M_nstates;
+  header.nclasses = _M_nclasses;
+  header.start = _M_start;
+  header.first_accepting = _M_first_accepting;
+  header.first_always_accepting = _M_first_always_accepting;
+  header.unanchored = _M_unanchored;
+
+  if (_M_accept) {
+    header.assertions = 1;
+    memcpy(header.starts, _M_starts, sizeof(_M_starts));
+  }
+
+  memcpy(header.classes, _M_classes, sizeof(_M_classes));
+
+  size_t count = _M_nstates * _M_nclasses;
+  header.checksum = checksum(header.classes,
+                             _M_dtran,
+                             count,
+                             _M_accept,
+                             _M_nstates);
+
+  return ((fwrite(&header, sizeof(image_header), 1, file) == 1) &&
+          (fwrite(_M_dtran, sizeof(state_id), count, file) == count) &&
+          ((!_M_accept) ||
+           (fwrite(_M_accept, 1, _M_nstates, file) == _M_nstates)));
+}
+
+bool lex::compiled_dfa::load(void* mapping, size_t size, size_t offset)
+{
+  // The table must be aligned.
+  if ((offset % alignof(image_header) != 0) ||
+      (offset > size) ||
+      (size - offset < sizeof(image_header))) {
+    return false;
+  }
+
+  const uint8_t* image = static_cast<const uint8_t*>(mapping) + offset;
+  const image_header* header = reinterpret_cast<const image_header*>(image);
+
+  if ((header->magic != image_magic) ||
+      (header->version != format_version) ||
+      (header->nstates == 0) ||
+      (header->nclasses == 0) ||
+      (header->nclasses > ARRAY_SIZE(_M_classes) + 1) ||
+      (header->start >= header->nstates) ||
+      (header->first_accepting > header->nstates) ||
+      (header->first_always_accepting < header->first_accepting) ||
+      (header->first_always_accepting > header->nstates) ||
+      (header->assertions > 1) ||
+      (header->unanchored > 1)) {
+    return false;
+  }
+
+  size_t count = static_cast<size_t>(header->nstates) * header->nclasses;
+  if ((size - offset - sizeof(image_header)) / sizeof(state_id) < count) {
+    return false;
+  }
+
+  // Accepting contexts (if any).
+  const uint8_t* accept = nullptr;
+  if (header->assertions) {
+    size_t left = size - offset - sizeof(image_header) -
+                  (count * sizeof(state_id));
+
+    if (left < header->nstates) {
+      return false;
+    }
+
+    for (size_t i = 0; i < ncontexts; i++) {
+      if (header->starts[i] >= header->nstates) {
+        return false;
+      }
+    }
+
+    accept = image + sizeof(image_header) + (count * sizeof(state_id));
+
+    for (size_t i = 0; i < header->nstates; i++) {
+      if (accept[i] >= (1u << ncontexts)) {
+        return false;
+      }
+    }
+  }
+
+  for (size_t i = 0; i < ARRAY_SIZE(_M_classes); i++) {
+    if (header->classes[i] >= header->nclasses) {
+      return false;
+    }
+  }
+
+  const state_id* dtran = reinterpret_cast<const state_id*>(
+                            image + sizeof(image_header)
+                          );
+
+  for (size_t i = 0; i < count; i++) {
+    if (dtran[i] >= header->nstates) {
+      return false;
+    }
+  }
+
+  if (checksum(header->classes,
+               dtran,
+               count,
+               accept,
+               header->nstates) != header->checksum) {
+    return false;
+  }
+
+  release_table();
+
+  memcpy(_M_classes, header->classes, sizeof(_M_classes));
+  _M_nclasses = header->nclasses;
+
+  // The mapping is read-only: the functions which modify the table replace
+  // it.
+  _M_dtran = const_cast<state_id*>(dtran);
+  _M_nstates = header->nstates;
+
+  _M_start = header->start;
+  _M_first_accepting = header->first_accepting;
+  _M_first_always_accepting = header->first_always_accepting;
+  _M_unanchored = (header->unanchored != 0);
+
+  _M_accept = const_cast<uint8_t*>(accept);
+  memcpy(_M_starts, header->starts, sizeof(_M_starts));
+
+  _M_mapping = mapping;
+  _M_mapping_size = size;
+
+  return true;
+}
+
+uint64_t lex::compiled_dfa::checksum(const uint16_t* classes,
+                            const state_id* dtran,
+                            size_t count,
+                            const uint8_t* accept,
+                            size_t nstates)
+{
+  // FNV-1a (on 16 and 32-bit words).
+  uint64_t h = 0xcbf29ce484222325ull;
+
+  for (size_t i = 0; i < ARRAY_SIZE(_M_classes); i++) {
+    h = (h ^ classes[i]) * 0x100000001b3ull;
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    h = (h ^ dtran[i]) * 0x100000001b3ull;
+  }
+
+  if (accept) {
+    for (size_t i = 0; i < nstates; i++) {
+      h = (h ^ accept[i]) * 0x100000001b3ull;
+    }
+  }
+
+  return h;
+}
+
+void lex::compiled_dfa::reset()
+{
+  // The table has been moved: it is not released.
+  _M_nclasses = 0;
+
+  _M_dtran = nullptr;
+  _M_nstates = 0;
+
+  _M_start = dead_state;
+  _M_first_accepting = 0;
+  _M_first_always_accepting = 0;
+  _M_unanchored = false;
+
+  _M_accept = nullptr;
+
+  _M_mapping = nullptr;
+  _M_mapping_size = 0;
+}
+
+void lex::compiled_dfa::release_table()
+{
+  release_accept();
+
+  if (_M_mapping) {
+    munmap(_M_mapping, _M_mapping_size);
+
+    _M_mapping = nullptr;
+    _M_mapping_size = 0;
+  } else if (_M_dtran) {
+    free(_M_dtran);
+  }
+
+  _M_dtran = nullptr;
+}
+
+void lex::compiled_dfa::release_accept()
+{
+  // The accepting contexts of a mapped image are released with the mapping.
+  if ((_M_accept) && (!_M_mapping)) {
+    free(_M_accept);
+  }
+
+  _M_accept = nullptr;
+}
+
+size_t lex::compiled_dfa::number_transitions() const
+{
+  // Transitions to the dead state (and from it) are not counted.
+  size_t count = 0;
+  for (size_t i = _M_nstates * _M_nclasses; i-- > _M_nclasses; ) {
+    if (_M_dtran[i] != dead_state) {
+      count++;
+    }
+  }
+
+  return count;
+}
+
+void lex::compiled_dfa::print() const
+{
+  printf("Number of states: %zu.\n", _M_nstates - 1);
+  printf("\n");
+
+  if (_M_accept) {
+    printf("Start states: %u (beginning of line), %u (after a word "
+           "character), %u (after another character).\n",
+           _M_starts[line_break],
+           _M_starts[word],
+           _M_starts[other]);
+    printf("\n");
+  }
+
+  for (size_t i = 1; i < _M_nstates; i++) {
+    if ((_M_accept) && (accepting(i))) {
+      // Contexts of the next character in which the state is accepting.
+      printf("State %zu (accepting state before:%s%s%s)\n",
+             i,
+             accepting(i, line_break) ? " end of line" : "",
+             accepting(i, word) ? " word character" : "",
+             accepting(i, other) ? " other character" : "");
+    } else {
+      printf("State %zu%s\n", i, accepting(i) ? " (accepting state)" : "");
+    }
+
+    for (size_t c = 0; c < ARRAY_SIZE(_M_classes); c++) {
+      state_id t;
+      if ((t = next(i, c)) != dead_state) {
+        // If the symbol is printable...
+        if (isprint(c)) {
+          printf("\t%c -> %u\n", static_cast<int>(c), t);
+        } else {
+          printf("\t0x%02x -> %u\n", static_cast<unsigned>(c), t);
+        }
+      }
+    }
+
+    printf("\n");
+  }
+}
+
+bool lex::compiled_dfa::match(const void* buf, size_t len) const
+{
+  const uint8_t* b = static_cast<const uint8_t*>(buf);
+
+  // The rest of the input doesn't need to be read once an always-accepting
+  // state has been reached.
+  state_id s = start_state(line_break);
+  for (size_t i = 0; (i < len) && (s < _M_first_always_accepting); i++) {
+    if ((s = next(s, b[i])) == dead_state) {
+      return false;
+    }
+  }
+
+  return accepting(s, line_break);
+}
+
+bool lex::compiled_dfa::is_match(const void* buf, size_t len) const
+{
+  const uint8_t* b = static_cast<const uint8_t*>(buf);
+
+  // The unanchored DFA is in an accepting state iff a match ends before the
+  // next byte.
+  if (_M_unanchored) {
+    state_id s = start_state(line_break);
+
+    for (size_t i = 0; i < len; i++) {
+      if (accepting(s, b, len, i)) {
+        return true;
+      }
+
+      if ((s = next(s, b[i])) == dead_state) {
+        return false;
+      }
+    }
+
+    return accepting(s, b, len, len);
+  }
+
+  if (_M_accept) {
+    for (size_t i = 0; i <= len; i++) {
+      state_id s = _M_starts[(i > 0) ? context(b[i - 1]) : line_break];
+
+      if (s == dead_state) {
+        if (!skip(b, len, i)) {
+          return false;
+        }
+
+        continue;
+      }
+
+      if (accepting(s, b, len, i)) {
+        return true;
+      }
+
+      for (size_t j = i; j < len; j++) {
+        if ((s = next(s, b[j])) == dead_state) {
+          break;
+        }
+
+        if (accepting(s, b, len, j + 1)) {
+          return true;
+        }
+      }
+    }
+
+    return false;
+  }
+
+  // The empty string matches.
+  if (accepting(_M_start)) {
+    return true;
+  }
+
+  for (size_t i = 0; i < len; i++) {
+    state_id s = _M_start;
+
+    for (size_t j = i; j < len; j++) {
+      if ((s = next(s, b[j])) == dead_state) {
+        break;
+      }
+
+      if (accepting(s)) {
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+bool lex::compiled_dfa::search(const void* buf,
+                      size_t len,
+                      size_t& start,
+                      size_t& end) const
+{
+  return search_from(static_cast<const uint8_t*>(buf), len, 0, start, end);
+}
+
+size_t lex::compiled_dfa::count(const void* buf, size_t len) const
+{
+  const uint8_t* b = static_cast<const uint8_t*>(buf);
+
+  size_t n = 0;
+
+  size_t start, end;
+  for (size_t i = 0; (i <= len) && (search_from(b, len, i, start, end)); n++) {
+    i = (end > start) ? end : end + 1;
+  }
+
+  return n;
+}
+
+size_t lex::compiled_dfa::count(const compiled_dfa& reverse,
+                                const void* buf,
+                                size_t len) const
+{
+  const uint8_t* b = static_cast<const uint8_t*>(buf);
+
+  // Offsets where a match starts (see search(reverse, ...)).
+  uint8_t* starts;
+  if ((starts = static_cast<uint8_t*>(malloc(len + 1))) == nullptr) {
+    return count(buf, len);
+  }
+
+  state_id s = reverse.start_state(line_break);
+
+  starts[len] = reverse.accepting(s,
+                                  (len > 0) ?
+                                    context(b[len - 1]) :
+                                    line_break);
+
+  for (size_t i = len; i-- > 0; ) {
+    starts[i] = (reverse.accepting(s = reverse.next(s, b[i]))) &&
+                ((!reverse._M_accept) ||
+                 (reverse.accepting(s,
+                                    (i > 0) ? context(b[i - 1]) : line_break)));
+  }
+
+  size_t n = 0;
+
+  for (size_t i = 0; i <= len; i++) {
+    if (!starts[i]) {
+      continue;
+    }
+
+    // Longest match from the start i.
+    size_t end = i;
+
+    s = start_state((i > 0) ? context(b[i - 1]) : line_break);
+
+    for (size_t j = i; j < len; j++) {
+      if ((s = next(s, b[j])) == dead_state) {
+        break;
+      }
+
+      if (accepting(s, b, len, j + 1)) {
+        // The longest match of an always-accepting state extends to the end
+        // of the input.
+        if (always_accepting(s)) {
+          end = len;
+          break;
+        }
+
+        end = j + 1;
+      }
+    }
+
+    n++;
+
+    // After an empty match, the next match starts at the next byte at the
+    // earliest.
+    if (end > i) {
+      i = end - 1;
+    }
+  }
+
+  free(starts);
+
+  return n;
+}
+
+bool lex::compiled_dfa::search_from(const uint8_t* b,
+                                    size_t len,
+                                    size_t from,
+                                    size_t& start,
+                                    size_t& end) const
+{
+  if (_M_accept) {
+    return search_assertions(b, len, from, start, end);
+  }
+
+  for (size_t i = from; i <= len; i++) {
+    state_id s = _M_start;
+
+    bool found;
+    if ((found = accepting(s)) == true) {
+      end = i;
+    }
+
+    for (size_t j = i; j < len; j++) {
+      if ((s = next(s, b[j])) == dead_state) {
+        break;
+      }
+
+      if (accepting(s)) {
+        found = true;
+
+        // The longest match of an always-accepting state extends to the end
+        // of the input.
+        if (always_accepting(s)) {
+          end = len;
+          break;
+        }
+
+        end = j + 1;
+      }
+    }
+
+    if (found) {
+      start = i;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool lex::compiled_dfa::search_assertions(const uint8_t* b,
+                                          size_t len,
+                                          size_t from,
+                                          size_t& start,
+                                          size_t& end) const
+{
+  for (size_t i = from; i <= len; i++) {
+    state_id s = _M_starts[(i > 0) ? context(b[i - 1]) : line_break];
+
+    if (s == dead_state) {
+      if (!skip(b, len, i)) {
+        return false;
+      }
+
+      continue;
+    }
+
+    bool found;
+    if ((found = accepting(s, b, len, i)) == true) {
+      end = i;
+    }
+
+    for (size_t j = i; j < len; j++) {
+      if ((s = next(s, b[j])) == dead_state) {
+        break;
+      }
+
+      if (accepting(s, b, len, j + 1)) {
+        found = true;
+
+        if (always_accepting(s)) {
+          end = len;
+          break;
+        }
+
+        end = j + 1;
+      }
+    }
+
+    if (found) {
+      start = i;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool lex::compiled_dfa::skip(const uint8_t* b, size_t len, size_t& i) const
+{
+  if ((_M_starts[word] == dead_state) && (_M_starts[other] == dead_state)) {
+    // No match can start anywhere.
+    if (_M_starts[line_break] == dead_state) {
+      return false;
+    }
+
+    const uint8_t* nl;
+    if ((nl = static_cast<const uint8_t*>(
+                memchr(b + i, '\n', len - i)
+              )) == nullptr) {
+      return false;
+    }
+
+    // The next match can start after the line break.
+    i = nl - b;
+  }
+
+  return true;
+}
+
+bool lex::compiled_dfa::search(const compiled_dfa& reverse,
+                               const void* buf,
+                               size_t len,
+                               size_t& start,
+                               size_t& end) const
+{
+  const uint8_t* b = static_cast<const uint8_t*>(buf);
+
+  // Backward scan: after reading the byte at offset i, the reverse DFA is in
+  // an accepting state iff a match starts at i (the unanchored reverse DFA
+  // never reaches the dead state). For the reverse DFA, the next character
+  // is the one before i.
+  state_id s = reverse.start_state(line_break);
+
+  bool found;
+  if ((found = reverse.accepting(s,
+                                 (len > 0) ?
+                                   context(b[len - 1]) :
+                                   line_break)) == true) {
+    start = len;
+  }
+
+  for (size_t i = len; i-- > 0; ) {
+    if (reverse.accepting(s = reverse.next(s, b[i]))) {
+      if ((!reverse._M_accept) ||
+          (reverse.accepting(s, (i > 0) ? context(b[i - 1]) : line_break))) {
+        start = i;
+        found = true;
+      }
+    }
+  }
+
+  if (!found) {
+    return false;
+  }
+
+  // Forward scan from the leftmost start: longest match.
+  s = start_state((start > 0) ? context(b[start - 1]) : line_break);
+
+  if (accepting(s, b, len, start)) {
+    end = start;
+  }
+
+  for (size_t i = start; i < len; i++) {
+    if ((s = next(s, b[i])) == dead_state) {
+      break;
+    }
+
+    if (accepting(s, b, len, i + 1)) {
+      end = i + 1;
+    }
+  }
+
+  return true;
+}
+
+bool lex::match_context::feed(const void* buf, size_t len)
+{
+  const uint8_t* b = static_cast<const uint8_t*>(buf);
+
+  state_id s = _M_state;
+  if (s == compiled_dfa::dead_state) {
+    return false;
+  }
+
+  for (size_t i = 0; i < len; i++) {
+    // The state accepts (or not) depending on the next byte.
+    if (_M_dfa->accepting(s, b, len, i)) {
+      // Every continuation matches: skip the rest of the input.
+      if (_M_dfa->always_accepting(s)) {
+        break;
+      }
+
+      _M_end = _M_offset + i;
+      _M_found = true;
+    }
+
+    if ((s = _M_dfa->next(s, b[i])) == compiled_dfa::dead_state) {
+      _M_offset += i + 1;
+      _M_state = s;
+
+      return false;
+    }
+  }
+
+  _M_offset += len;
+  _M_state = s;
+
+  return true;
+}
@@ -0,0 +1,449 @@
+#ifndef LEX_COMPILED_DFA_H
+#define LEX_COMPILED_DFA_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace lex {
+  // State identifier in the frozen transition table.
+  typedef uint32_t state_id;
+
+  // Frozen DFA: the transition table built by lex::dfa (see dfa::freeze()).
+  // It is immutable: the const member functions don't modify it, so a
+  // compiled DFA can be shared among threads (e.g. with a
+  // std::shared_ptr<const compiled_dfa>) without locking. It can be moved,
+  // but not copied.
+  class compiled_dfa {
+    public:
+      // The dead state: it is not accepting and all its transitions lead back
+      // to itself.
+      static const state_id dead_state = 0;
+
+      // Version of the format of the images written by save().
+      static const uint32_t format_version = 3;
+
+      // Contexts of the assertions (^, $, \b and \B): the kind of the byte
+      // before or after an offset. The beginning and the end of the input
+      // count as line breaks.
+      static const size_t line_break = 0; // '\n'
+      static const size_t word = 1; // [0-9A-Za-z_]
+      static const size_t other = 2;
+
+      static const size_t ncontexts = 3;
+
+      // Get the context of a byte.
+      static size_t context(uint8_t c);
+
+      // Constructor.
+      compiled_dfa();
+
+      // Move constructor.
+      compiled_dfa(compiled_dfa&& other);
+
+      // Destructor.
+      ~compiled_dfa();
+
+      // Move assignment operator.
+      compiled_dfa& operator=(compiled_dfa&& other);
+
+      // Save the frozen DFA (in the native byte order).
+      bool save(FILE* file) const;
+
+      // Load a frozen DFA saved by save() from the memory mapping 'mapping'
+      // of 'size' bytes, at 'offset'. The transition table is not copied:
+      // the DFA takes ownership of the mapping, which is unmapped when the
+      // DFA is destroyed or rebuilt. If the image is not valid, false is
+      // returned and the mapping is not taken.
+      bool load(void* mapping, size_t size, size_t offset);
+
+      // Get number of states (including the dead state).
+      size_t number_states() const;
+
+      // Get number of transitions (not counting the ones to the dead state).
+      size_t number_transitions() const;
+
+      // Get number of byte classes.
+      size_t number_classes() const;
+
+      // Get the byte class of a character.
+      size_t byte_class(uint8_t c) const;
+
+      // Get start state.
+      state_id start_state() const;
+
+      // Get the start state of a match which starts after a byte of context
+      // 'prev' (line_break at the beginning of the input).
+      state_id start_state(size_t prev) const;
+
+      // Get first accepting state.
+      state_id first_accepting_state() const;
+
+      // Get first always-accepting state.
+      state_id first_always_accepting_state() const;
+
+      // Get next state.
+      state_id next(state_id s, uint8_t c) const;
+      state_id next_by_class(state_id s, size_t cls) const;
+
+      // Accepting state? With assertions, the state may be accepting only
+      // for some contexts of the next byte.
+      bool accepting(state_id s) const;
+
+      // Accepting state if the next byte has the context 'next' (line_break
+      // at the end of the input)?
+      bool accepting(state_id s, size_t next) const;
+
+      // Accepting state at the offset 'i' of the input (before the byte
+      // b[i])?
+      bool accepting(state_id s,
+                     const uint8_t* b,
+                     size_t len,
+                     size_t i) const;
+
+      // Always-accepting state? Every continuation of the input matches: the
+      // state is accepting in any context and all its transitions lead to
+      // always-accepting states. The always-accepting states occupy the
+      // range [first_always_accepting_state(), number_states()).
+      bool always_accepting(state_id s) const;
+
+      // Has the regular expression assertions?
+      bool has_assertions() const;
+
+      // Does the whole input match?
+      bool match(const void* buf, size_t len) const;
+
+      // Is there a match anywhere in the input? It stops at the first
+      // accepting state, without looking for the leftmost-longest match. The
+      // unanchored DFA (see dfa::build_unanchored()) reads the input once,
+      // the anchored DFA restarts at every offset (quadratic time when there
+      // is no match).
+      bool is_match(const void* buf, size_t len) const;
+
+      // Search the leftmost-longest match (it stops at the first one).
+      bool search(const void* buf,
+                  size_t len,
+                  size_t& start,
+                  size_t& end) const;
+
+      // Count the non-overlapping leftmost-longest matches without saving
+      // them (after an empty match, the search goes on from the next byte).
+      // The search restarts at every offset (quadratic time when there is no
+      // match).
+      size_t count(const void* buf, size_t len) const;
+
+      // Count the matches in linear time, with the unanchored reverse DFA of
+      // the same regular expression (see dfa::build_reverse()): the input is
+      // scanned backward once to find the offsets where a match starts, and
+      // forward from each start which follows the previous match to find its
+      // longest end.
+      size_t count(const compiled_dfa& reverse,
+                   const void* buf,
+                   size_t len) const;
+
+      // Search the leftmost-longest match in linear time, with the
+      // unanchored reverse DFA of the same regular expression (see
+      // dfa::build_reverse()): the input is scanned backward to find the
+      // leftmost start and then forward from it to find the longest end.
+      bool search(const compiled_dfa& reverse,
+                  const void* buf,
+                  size_t len,
+                  size_t& start,
+                  size_t& end) const;
+
+      // Print.
+      void print() const;
+
+    protected:
+      // Byte classes: class 0 groups the characters which don't appear in the
+      // regular expression, class i + 1 is the symbol i of the regular
+      // expression.
+      uint16_t _M_classes[256];
+      size_t _M_nclasses;
+
+      // Frozen transition table (_M_nstates x _M_nclasses).
+      state_id* _M_dtran;
+      size_t _M_nstates;
+
+      state_id _M_start;
+      state_id _M_first_accepting;
+      state_id _M_first_always_accepting;
+
+      // Does the DFA restart at every byte (see dfa::build_unanchored())?
+      bool _M_unanchored;
+
+      // With assertions, the contexts of the next byte in which each state is
+      // accepting (bit mask per state) and the start state after each
+      // context of the previous byte (null without assertions: every
+      // accepting state accepts in any context and there is a single start
+      // state).
+      uint8_t* _M_accept;
+      state_id _M_starts[ncontexts];
+
+      // Memory mapping of the frozen transition table (if it has been loaded
+      // by load()).
+      void* _M_mapping;
+      size_t _M_mapping_size;
+
+      // Release the frozen transition table (and the accepting contexts).
+      void release_table();
+
+      // Release the accepting contexts.
+      void release_accept();
+
+      // Search the leftmost-longest match which starts at the offset 'from'
+      // or after it.
+      bool search_from(const uint8_t* b,
+                       size_t len,
+                       size_t from,
+                       size_t& start,
+                       size_t& end) const;
+
+      // Search the leftmost-longest match of a regular expression with
+      // assertions which starts at the offset 'from' or after it.
+      bool search_assertions(const uint8_t* b,
+                             size_t len,
+                             size_t from,
+                             size_t& start,
+                             size_t& end) const;
+
+      // Skip the offsets after 'i' where no match of a regular expression
+      // with assertions can start: if no match can start after a word byte
+      // nor after another byte ('^'), 'i' is moved to the next line break.
+      // Returns false if there is none.
+      bool skip(const uint8_t* b, size_t len, size_t& i) const;
+
+    private:
+      // Header of the images written by save(). It is followed by the frozen
+      // transition table and, with assertions, by the accepting contexts of
+      // the states.
+      struct image_header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t nstates;
+        uint32_t nclasses;
+        state_id start;
+        state_id first_accepting;
+        state_id first_always_accepting;
+        uint32_t assertions;
+        uint32_t unanchored;
+        state_id starts[ncontexts];
+        uint64_t checksum;
+        uint16_t classes[256];
+      };
+
+      static const uint32_t image_magic = 0x4c444641; // "LDFA"
+
+      // Compute the checksum of the byte classes, the frozen transition table
+      // and the accepting contexts (if any).
+      static uint64_t checksum(const uint16_t* classes,
+                               const state_id* dtran,
+                               size_t count,
+                               const uint8_t* accept,
+                               size_t nstates);
+
+      // Forget the transition table (after it has been moved).
+      void reset();
+
+      // Disable copy constructor and assignment operator.
+      compiled_dfa(const compiled_dfa&) = delete;
+      compiled_dfa& operator=(const compiled_dfa&) = delete;
+  };
+
+  // Match context: the mutable state of a match of a compiled DFA against
+  // an input which is fed in chunks (the match is anchored at the beginning
+  // of the input). Each thread uses its own contexts, the compiled DFA is
+  // shared.
+  class match_context {
+    public:
+      // Constructor.
+      match_context(const compiled_dfa& d);
+
+      // Restart the match.
+      void reset();
+
+      // Feed input. Returns false if no further input can match (the dead
+      // state has been reached).
+      bool feed(const void* buf, size_t len);
+
+      // Does the input fed so far match?
+      bool matched() const;
+
+      // Get the end of the longest prefix of the input which matches.
+      bool longest_match(size_t& end) const;
+
+      // Get the current state.
+      state_id state() const;
+
+      // Get number of bytes consumed.
+      size_t offset() const;
+
+    private:
+      const compiled_dfa* _M_dfa;
+
+      state_id _M_state;
+      size_t _M_offset;
+
+      // Longest match which ends before the current offset.
+      size_t _M_end;
+      bool _M_found;
+  };
+
+  inline compiled_dfa::compiled_dfa()
+    : _M_nclasses(0),
+      _M_dtran(nullptr),
+      _M_nstates(0),
+      _M_start(dead_state),
+      _M_first_accepting(0),
+      _M_first_always_accepting(0),
+      _M_unanchored(false),
+      _M_accept(nullptr),
+      _M_mapping(nullptr),
+      _M_mapping_size(0)
+  {
+  }
+
+  inline compiled_dfa::~compiled_dfa()
+  {
+    release_table();
+  }
+
+  inline size_t compiled_dfa::number_states() const
+  {
+    return _M_nstates;
+  }
+
+  inline size_t compiled_dfa::number_classes() const
+  {
+    return _M_nclasses;
+  }
+
+  inline size_t compiled_dfa::byte_class(uint8_t c) const
+  {
+    return _M_classes[c];
+  }
+
+  inline size_t compiled_dfa::context(uint8_t c)
+  {
+    if (c == '\n') {
+      return line_break;
+    }
+
+    if (((c >= '0') && (c <= '9')) ||
+        ((c >= 'A') && (c <= 'Z')) ||
+        ((c >= 'a') && (c <= 'z')) ||
+        (c == '_')) {
+      return word;
+    }
+
+    return other;
+  }
+
+  inline state_id compiled_dfa::start_state() const
+  {
+    return _M_start;
+  }
+
+  inline state_id compiled_dfa::start_state(size_t prev) const
+  {
+    return _M_accept ? _M_starts[prev] : _M_start;
+  }
+
+  inline state_id compiled_dfa::first_accepting_state() const
+  {
+    return _M_first_accepting;
+  }
+
+  inline state_id compiled_dfa::first_always_accepting_state() const
+  {
+    return _M_first_always_accepting;
+  }
+
+  inline state_id compiled_dfa::next(state_id s, uint8_t c) const
+  {
+    return _M_dtran[(s * _M_nclasses) + _M_classes[c]];
+  }
+
+  inline state_id compiled_dfa::next_by_class(state_id s, size_t cls) const
+  {
+    return _M_dtran[(s * _M_nclasses) + cls];
+  }
+
+  inline bool compiled_dfa::accepting(state_id s) const
+  {
+    return (s >= _M_first_accepting);
+  }
+
+  inline bool compiled_dfa::accepting(state_id s, size_t next) const
+  {
+    return (s >= _M_first_accepting) &&
+           ((!_M_accept) || ((_M_accept[s] >> next) & 1));
+  }
+
+  inline bool compiled_dfa::accepting(state_id s,
+                                      const uint8_t* b,
+                                      size_t len,
+                                      size_t i) const
+  {
+    return (s >= _M_first_accepting) &&
+           ((!_M_accept) ||
+            ((_M_accept[s] >> ((i < len) ? context(b[i]) : line_break)) & 1));
+  }
+
+  inline bool compiled_dfa::always_accepting(state_id s) const
+  {
+    return (s >= _M_first_always_accepting);
+  }
+
+  inline bool compiled_dfa::has_assertions() const
+  {
+    return (_M_accept != nullptr);
+  }
+
+  inline match_context::match_context(const compiled_dfa& d)
+    : _M_dfa(&d)
+  {
+    reset();
+  }
+
+  inline void match_context::reset()
+  {
+    _M_state = _M_dfa->start_state();
+    _M_offset = 0;
+
+    _M_end = 0;
+    _M_found = false;
+  }
+
+  inline bool match_context::matched() const
+  {
+    // The end of the input fed so far is taken as the end of the input.
+    return (_M_state != compiled_dfa::dead_state) &&
+           (_M_dfa->accepting(_M_state, compiled_dfa::line_break));
+  }
+
+  inline bool match_context::longest_match(size_t& end) const
+  {
+    if (matched()) {
+      end = _M_offset;
+      return true;
+    } else if (_M_found) {
+      end = _M_end;
+      return true;
+    }
+
+    return false;
+  }
+
+  inline state_id match_context::state() const
+  {
+    return _M_state;
+  }
+
+  inline size_t match_context::offset() const
+  {
+    return _M_offset;
+  }
+}
+
+#endif // LEX_COMPILED_DFA_H
@@ -1,60 +1,270 @@
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/mman.h>
+#include <algorithm>
+#include <atomic>
 #include <memory>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 #include "lex/dfa.h"
+#include "macros/macros.h"
 
-bool lex::dfa::build(const regular_expression& regex)
+bool lex::dfa::build(const regular_expression& regex, stats* st)
 {
+  return construct(regex, false, false, st);
+}
+
+bool lex::dfa::build_unanchored(const regular_expression& regex, stats* st)
+{
+  return construct(regex, false, true, st);
+}
+
+bool lex::dfa::build_reverse(const regular_expression& regex,
+                             bool unanchored,
+                             stats* st)
+{
+  return construct(regex, true, unanchored, st);
+}
+
+bool lex::dfa::construct(const regular_expression& regex,
+                         bool reverse,
+                         bool unanchored,
+                         stats* st)
+{
+  if (!regex.root()) {
+    return false;
+  }
+
   // Save number of positions.
   _M_npositions = regex.number_positions();
 
-  if ((_M_followpos = new (std::nothrow) positions[_M_npositions]) != nullptr) {
-    // Compute followpos for T.
-    if (compute_followpos(regex.root())) {
+  double start = st ? stats::now() : 0.0;
+
+  bool ret = false;
+
+  _M_pool.clear();
+  _M_sets.clear();
+
+  release_accept();
+
+  _M_unanchored = unanchored;
+
+  if (regex.has_assertions()) {
+    if ((_M_assertions = static_cast<uint8_t*>(
+                           _M_arena.allocate(_M_npositions, 1)
+                         )) == nullptr) {
+      return false;
+    }
+
+    memset(_M_assertions, 0, _M_npositions);
+
+    for (size_t i = 0; i < regex.number_nodes(); i++) {
+      const node* n = regex.get_node(i);
+
+      if (n->t == node::type::assertion) {
+        uint8_t kind = n->s;
+
+        // The reverse DFA reads the input backward: the previous byte is
+        // the one after the assertion.
+        if (reverse) {
+          if (kind == '^') {
+            kind = '$';
+          } else if (kind == '$') {
+            kind = '^';
+          }
+        }
+
+        _M_assertions[n->pos] = kind;
+      }
+    }
+  }
+
+  if ((_M_followpos = static_cast<const position_set**>(
+                        _M_arena.allocate(
+                          _M_npositions * sizeof(const position_set*),
+                          alignof(const position_set*)
+                        )
+                      )) != nullptr) {
+    // Compute followpos for T. The sets are built in a scratch arena and then
+    // interned.
+    arena scratch;
+    positions* followpos;
+    position_set* initial = nullptr;
+    if (((followpos = scratch.create_array<positions>(_M_npositions,
+                                                      &scratch)) != nullptr) &&
+        (compute_followpos(regex, followpos)) &&
+        ((!reverse) || (invert_followpos(regex, scratch, followpos))) &&
+        (intern_followpos(followpos)) &&
+        ((initial = _M_pool.intern(
+                      reverse ?
+                        followpos[_M_npositions - 1] :
+                        regex.root()->firstpos
+                    )) != nullptr)) {
+      if (st) {
+        double end = stats::now();
+        st->followpos_time = end - start;
+        st->sample_heap();
+
+        st->followpos = 0;
+        for (size_t i = 0; i < _M_npositions; i++) {
+          st->followpos += _M_followpos[i]->size;
+        }
+
+        st->followpos_sets = _M_pool.size();
+
+        start = end;
+      }
+
+      scratch.clear();
+
       // Construct Dstates, the set of states of DFA D, and Dtran, the
       // transition function for D.
-      return construct_transition_function(regex);
+      if ((ret = construct_transition_function(regex,
+                                               initial,
+                                               unanchored)) && (st)) {
+        st->subset_time = stats::now() - start;
+        st->sample_heap();
+
+        st->states = _M_nstates - 1;
+        st->transitions = number_transitions();
+        st->position_sets = _M_pool.size();
+      }
     }
   }
 
-  return false;
+  // The followpos array and the scratch data are not needed anymore: release
+  // them at once.
+  _M_followpos = nullptr;
+  _M_restart = nullptr;
+  _M_assertions = nullptr;
+  _M_arena.clear();
+
+  return ret;
 }
 
-bool lex::dfa::compute_followpos(const node* n)
-{
-  // If not a leaf node...
-  if (!n->leaf()) {
-    if (((!n->left) || (compute_followpos(n->left))) &&
-        ((!n->right) || (compute_followpos(n->right)))) {
-      switch (n->t) {
-        case node::type::concatenation:
-          // If n is a cat-node with left child c1 and right child c2, then for
-          // every position i in lastpos(c1), all positions in firspos(c2) are
-          // in followpos(i).
-          for (size_t i = 0; i < n->left->lastpos.size(); i++) {
-            if (!_M_followpos[n->left->lastpos.get(i)]
-                .add(n->right->firstpos)) {
-              return false;
-            }
+bool lex::dfa::build(const char* const* literals,
+                     size_t count,
+                     const regular_expression* regex,
+                     stats* st)
+{
+  double start = st ? stats::now() : 0.0;
+
+  bool ret;
+
+  if (regex) {
+    // Build the trie and the DFA of the regular expression separately and
+    // then compute their union.
+    dfa trie;
+    dfa d;
+    d.set_threads(_M_nthreads);
+
+    ret = ((trie.build_trie(literals, count)) &&
+           (d.build(*regex)) &&
+           (unite(trie, d)));
+  } else {
+    ret = build_trie(literals, count);
+  }
+
+  if ((ret) && (st)) {
+    st->subset_time = stats::now() - start;
+    st->sample_heap();
+
+    st->states = _M_nstates - 1;
+    st->transitions = number_transitions();
+  }
+
+  return ret;
+}
+
+bool lex::dfa::compute_followpos(const regular_expression& regex,
+                                  positions* followpos)
+{
+  for (size_t i = 0; i < regex.number_nodes(); i++) {
+    const node* n = regex.get_node(i);
+
+    switch (n->t) {
+      case node::type::concatenation:
+        // If n is a cat-node with left child c1 and right child c2, then for
+        // every position i in lastpos(c1), all positions in firspos(c2) are in
+        // followpos(i).
+        for (size_t j = 0; j < n->left->lastpos.size(); j++) {
+          if (!followpos[n->left->lastpos.get(j)].add(n->right->firstpos)) {
+            return false;
           }
+        }
 
-          break;
-        case node::type::repetition_zero_or_more:
-        case node::type::repetition_one_or_more:
-          // If n is a star-node, and i is a position in lastpos(n), then all
-          // positions in firstpos(n) are in followpos(i).
-          for (size_t i = 0; i < n->left->lastpos.size(); i++) {
-            if (!_M_followpos[n->left->lastpos.get(i)].add(n->left->firstpos)) {
-              return false;
-            }
+        break;
+      case node::type::repetition_zero_or_more:
+      case node::type::repetition_one_or_more:
+        // If n is a star-node, and i is a position in lastpos(n), then all
+        // positions in firstpos(n) are in followpos(i).
+        for (size_t j = 0; j < n->left->lastpos.size(); j++) {
+          if (!followpos[n->left->lastpos.get(j)].add(n->left->firstpos)) {
+            return false;
           }
+        }
+
+        break;
+      case node::type::alternation:
+      case node::type::optional:
+      case node::type::group:
+      case node::type::symbol:
+      case node::type::char_class:
+      case node::type::assertion:
+      case node::type::endmark:
+        break;
+    }
+  }
 
-          break;
-        case node::type::alternation:
-        case node::type::optional:
-        case node::type::symbol:
-        case node::type::endmark:
-          break;
+  return true;
+}
+
+bool lex::dfa::invert_followpos(const regular_expression& regex,
+                                 arena& a,
+                                 positions*& followpos) const
+{
+  // The endmark (the last position) plays the role of the beginning of the
+  // input: precedepos(q) contains it if q is in firstpos of the regular
+  // expression, and the initial state is precedepos(endmark) (lastpos of
+  // the regular expression), plus the endmark itself if the regular
+  // expression is nullable.
+  position endmark = _M_npositions - 1;
+
+  positions* precedepos;
+  if ((precedepos = a.create_array<positions>(_M_npositions, &a)) ==
+      nullptr) {
+    return false;
+  }
+
+  // q is in precedepos(p) if p is in followpos(q). The positions q are
+  // visited in order, so they are appended to the sets.
+  for (size_t q = 0; q < _M_npositions; q++) {
+    for (size_t i = 0; i < followpos[q].size(); i++) {
+      if (!precedepos[followpos[q].get(i)].add(q)) {
+        return false;
       }
-    } else {
+    }
+  }
+
+  const positions& firstpos = regex.root()->firstpos;
+  for (size_t i = 0; i < firstpos.size(); i++) {
+    if (!precedepos[firstpos.get(i)].add(endmark)) {
+      return false;
+    }
+  }
+
+  followpos = precedepos;
+
+  return true;
+}
+
+bool lex::dfa::intern_followpos(const positions* followpos)
+{
+  for (size_t i = 0; i < _M_npositions; i++) {
+    if ((_M_followpos[i] = _M_pool.intern(followpos[i])) == nullptr) {
       return false;
     }
   }
@@ -62,83 +272,1153 @@ bool lex::dfa::compute_followpos(const node* n)
   return true;
 }
 
-bool lex::dfa::construct_transition_function(const regular_expression& regex)
+bool lex::dfa::construct_transition_function(const regular_expression& regex,
+                                             position_set* initial,
+                                             bool unanchored)
 {
+  // Byte classes.
+  for (size_t i = 0; i < ARRAY_SIZE(_M_classes); i++) {
+    _M_classes[i] = 0;
+  }
+
+  for (size_t i = 0; i < regex.number_symbols(); i++) {
+    _M_classes[static_cast<uint8_t>(regex.get_symbol(i))] = i + 1;
+  }
+
+  _M_nclasses = regex.number_symbols() + 1;
+
+  // With assertions, the bytes which don't appear in the regular expression
+  // are split by context: class 0 (other bytes), class nsymbols + 1 (word
+  // bytes) and class nsymbols + 2 ('\n'), as they restart an unanchored DFA
+  // in different states.
+  if (_M_assertions) {
+    for (size_t i = 0; i < ARRAY_SIZE(_M_classes); i++) {
+      if (_M_classes[i] == 0) {
+        switch (context(i)) {
+          case word:
+            _M_classes[i] = _M_nclasses;
+            break;
+          case line_break:
+            _M_classes[i] = _M_nclasses + 1;
+            break;
+        }
+      }
+    }
+
+    _M_nclasses += 2;
+  }
+
+  // The state with index i in Dstates will have the id i + 1 (the id 0 is
+  // reserved for the dead state).
+  size_t rows = 0;
+
   // Initialize Dstates to contain only the unmarked state firstpos(n0), where
   // n0 is the root of syntax tree T for (r)#;
+  // The states are interned sets of positions, which know their index in
+  // Dstates, so "U is not in Dstates" is a pointer comparison.
   states dstates;
 
-  state* s;
-  if ((s = state::create(regex.root()->firstpos)) != nullptr) {
-    if (dstates.add(s)) {
-      // while (there is an unmarked state S in Dstates) {
-      do {
-        s = nullptr;
+  size_t nsymbols = regex.number_symbols();
 
-        for (size_t i = 0; i < dstates.size(); i++) {
-          if (!dstates.get(i)->marked()) {
-            s = dstates.get(i);
-            break;
-          }
-        }
+  size_t nthreads = number_threads();
 
-        if (!s) {
-          break;
-        }
+  // The successors of the unmarked states are computed in batches (in
+  // parallel when there are enough states) into per-thread arenas and then
+  // added to Dstates in order, so the states get the same ids as with a
+  // single thread.
+  std::unique_ptr<arena[]> arenas(new (std::nothrow) arena[nthreads]);
+  std::vector<successor> successors;
+
+  // Scratch states (U), one per thread. They are reused for all the states
+  // and symbols, so they only allocate memory when they grow.
+  std::vector<state> scratch(nthreads);
+
+  // In an unanchored DFA, the initial state is added to every state.
+  _M_restart = unanchored ? initial : nullptr;
+
+  // Initial states (one per context of the previous byte).
+  state_id starts[ncontexts];
+
+  if ((arenas) && (add_initial_states(initial, dstates, starts))) {
+    // while (there is an unmarked state S in Dstates) {
+    // The states are marked in the order in which they are added, so the
+    // unmarked states are the ones after the last marked state.
+    for (size_t first = 0; first < dstates.size(); ) {
+      size_t last = MIN(dstates.size(), first + max_batch_states);
+
+      successors.resize((last - first) * nsymbols);
+
+      // for (each input symbol a) {
+      //   let U be the union of followpos(p) for all p in S that correspond
+      //   to a;
+      if (!compute_successors(regex,
+                              dstates,
+                              first,
+                              last,
+                              arenas.get(),
+                              scratch.data(),
+                              successors.data())) {
+        return false;
+      }
+
+      // Make room for the rows of the dead state and of the batch.
+      if (!allocate_rows(last + 1, rows)) {
+        return false;
+      }
 
+      for (size_t idx = first; idx < last; idx++) {
         // mark S;
-        s->mark();
-
-        // for (each input symbol a) {
-        for (size_t i = 0; i < regex.number_symbols(); i++) {
-          // let U be the union of followpos(p) for all p in S that correspond
-          // to a;
-          state* u;
-          if ((u = new (std::nothrow) state()) != nullptr) {
-            for (size_t j = 0; j < s->size(); j++) {
-              position p = s->get(j);
-
-              if (regex.get_positions(i).contains(p)) {
-                if (!u->add(_M_followpos[p])) {
-                  delete u;
-                  return false;
-                }
-              }
-            }
+        const position_set* s = dstates.get(idx);
 
-            if (!u->empty()) {
-              // if (U is not in Dstates)
-              if (!dstates.contains(*u)) {
-                // add U as an unmarked state to Dstates;
-                if (dstates.add(u)) {
-                  if ((u = state::create(*u)) == nullptr) {
-                    return false;
-                  }
-                } else {
-                  delete u;
-                  return false;
-                }
-              }
+        const successor* succ = successors.data() + ((idx - first) * nsymbols);
+
+        // The bytes which don't appear in the regular expression lead to
+        // the dead state (or back to the initial state in an unanchored
+        // DFA).
+        state_id* row = _M_dtran + ((idx + 1) * _M_nclasses);
+        row[0] = _M_restart ? starts[other] : dead_state;
+
+        if (_M_assertions) {
+          row[nsymbols + 1] = _M_restart ? starts[word] : dead_state;
+          row[nsymbols + 2] = _M_restart ? starts[line_break] : dead_state;
+        }
+
+        for (size_t i = 0; i < nsymbols; i++) {
+          row[i + 1] = dead_state;
+
+          if (succ[i].size > 0) {
+            position_set* u;
+            if ((u = _M_pool.intern(succ[i].data,
+                                    succ[i].size,
+                                    succ[i].hash)) == nullptr) {
+              return false;
+            }
 
-              // Dtran[S, a] = U;
-              if (!_M_transition_table.add(*s, regex.get_symbol(i), u)) {
-                delete u;
+            // if (U is not in Dstates)
+            size_t target;
+            if (!dstates.find(u, target)) {
+              // add U as an unmarked state to Dstates;
+              if (!dstates.add(u)) {
                 return false;
               }
-            } else {
-              delete u;
+
+              target = dstates.size() - 1;
+            }
+
+            row[i + 1] = target + 1;
+
+            // Dtran[S, a] = U;
+            if (!_M_transition_table.add(s, regex.get_symbol(i), u)) {
+              return false;
             }
-          } else {
-            return false;
           }
         }
-      } while (true);
+      }
+
+      for (size_t i = 0; i < nthreads; i++) {
+        arenas[i].clear();
+      }
+
+      first = last;
+    }
 
-      return true;
+    // Row of the dead state.
+    for (size_t i = 0; i < _M_nclasses; i++) {
+      _M_dtran[i] = dead_state;
     }
 
-    delete s;
+    _M_nstates = dstates.size() + 1;
+    _M_start = starts[line_break];
+
+    // A state is accepting if it contains the position of the endmark (with
+    // assertions, if the endmark is reachable before the next byte).
+    bool* accept;
+    if ((accept = new (std::nothrow) bool[_M_nstates]) != nullptr) {
+      accept[dead_state] = false;
+
+      if (_M_assertions) {
+        if ((_M_accept = static_cast<uint8_t*>(malloc(_M_nstates))) ==
+            nullptr) {
+          delete [] accept;
+          return false;
+        }
+
+        _M_accept[dead_state] = 0;
+
+        state c;
+        for (size_t i = 0; i < dstates.size(); i++) {
+          bool blocked;
+          if (!accept_contexts(dstates.get(i), c, _M_accept[i + 1], blocked)) {
+            delete [] accept;
+            return false;
+          }
+
+          accept[i + 1] = (_M_accept[i + 1] != 0);
+        }
+
+        memcpy(_M_starts, starts, sizeof(_M_starts));
+      } else {
+        for (size_t i = 0; i < dstates.size(); i++) {
+          accept[i + 1] = dstates.get(i)->contains(_M_npositions - 1);
+        }
+      }
+
+      bool ret = layout(accept, nullptr);
+
+      delete [] accept;
+
+      return ret;
+    }
   }
 
   return false;
 }
+
+size_t lex::dfa::number_threads() const
+{
+  if (_M_nthreads > 0) {
+    return _M_nthreads;
+  }
+
+  return MAX(std::thread::hardware_concurrency(), 1u);
+}
+
+bool lex::dfa::compute_successors(const regular_expression& regex,
+                                   const states& dstates,
+                                   size_t first,
+                                   size_t last,
+                                   arena* arenas,
+                                   state* scratch,
+                                   successor* successors) const
+{
+  size_t nsymbols = regex.number_symbols();
+
+  size_t nthreads = MIN(number_threads(), (last - first) / min_parallel_states);
+
+  if (nthreads <= 1) {
+    for (size_t idx = first; idx < last; idx++) {
+      if (!compute_successors(regex,
+                              dstates.get(idx),
+                              scratch[0],
+                              arenas[0],
+                              successors + ((idx - first) * nsymbols))) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  // The workers take the states in order; each one writes the successors
+  // of its states in their slots.
+  std::atomic<size_t> next(first);
+  std::atomic<bool> error(false);
+
+  auto worker = [&](size_t t) {
+    size_t idx;
+    while (((idx = next++) < last) && (!error)) {
+      if (!compute_successors(regex,
+                              dstates.get(idx),
+                              scratch[t],
+                              arenas[t],
+                              successors + ((idx - first) * nsymbols))) {
+        error = true;
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+
+  try {
+    for (size_t t = 1; t < nthreads; t++) {
+      threads.emplace_back(worker, t);
+    }
+  } catch (const std::system_error&) {
+    // Continue with the threads which could be created.
+  }
+
+  worker(0);
+
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  return !error;
+}
+
+bool lex::dfa::compute_successors(const regular_expression& regex,
+                                   const position_set* s,
+                                   state& u,
+                                   arena& a,
+                                   successor* successors) const
+{
+  // With assertions, the positions which can match a byte depend on the
+  // context of the byte.
+  state closures[ncontexts] = {state(&a), state(&a), state(&a)};
+  if (_M_assertions) {
+    for (size_t n = 0; n < ncontexts; n++) {
+      if (!closure(s, n, closures[n])) {
+        return false;
+      }
+    }
+  }
+
+  for (size_t i = 0; i < regex.number_symbols(); i++) {
+    u.clear();
+
+    if ((_M_restart) && (!u.add(*_M_restart))) {
+      return false;
+    }
+
+    if (_M_assertions) {
+      size_t n = context(static_cast<uint8_t>(regex.get_symbol(i)));
+      const positions& c = closures[n].get_positions();
+
+      for (size_t j = 0; j < c.size(); j++) {
+        position p = c.get(j);
+
+        if ((p < _M_npositions) && (regex.get_positions(i).contains(p))) {
+          if (!u.add(*_M_followpos[p])) {
+            return false;
+          }
+        }
+      }
+
+      // The assertions of U will be resolved after this byte.
+      if ((has_assertions(u.get_positions().data(), u.size())) &&
+          (!u.add(_M_npositions + n))) {
+        return false;
+      }
+    } else {
+      for (size_t j = 0; j < s->size; j++) {
+        position p = s->data[j];
+
+        if (regex.get_positions(i).contains(p)) {
+          if (!u.add(*_M_followpos[p])) {
+            return false;
+          }
+        }
+      }
+    }
+
+    successor* succ = successors + i;
+
+    if ((succ->size = u.size()) > 0) {
+      position* data;
+      if ((data = static_cast<position*>(
+                    a.allocate(u.size() * sizeof(position), alignof(position))
+                  )) == nullptr) {
+        return false;
+      }
+
+      memcpy(data, u.get_positions().data(), u.size() * sizeof(position));
+
+      succ->data = data;
+      succ->hash = position_pool::hash(data, u.size());
+    } else {
+      succ->data = nullptr;
+      succ->hash = 0;
+    }
+  }
+
+  return true;
+}
+
+bool lex::dfa::add_initial_states(position_set* initial,
+                                  states& dstates,
+                                  state_id* starts)
+{
+  if (!has_assertions(initial->data, initial->size)) {
+    if (!dstates.add(initial)) {
+      return false;
+    }
+
+    for (size_t k = 0; k < ncontexts; k++) {
+      starts[k] = 1;
+    }
+
+    return true;
+  }
+
+  state s;
+  state c;
+
+  for (size_t k = 0; k < ncontexts; k++) {
+    s.clear();
+
+    position_set* set;
+    if ((!s.add(*initial)) ||
+        (!s.add(_M_npositions + k)) ||
+        ((set = _M_pool.intern(s.get_positions())) == nullptr)) {
+      return false;
+    }
+
+    // In an anchored DFA, a match can't start after a byte in whose context
+    // the assertions never hold (e.g. '^' after a word byte): the start state
+    // is the dead state, so the search skips these offsets.
+    if ((!_M_restart) && (k != line_break)) {
+      uint8_t mask;
+      bool blocked;
+      if (!accept_contexts(set, c, mask, blocked)) {
+        return false;
+      }
+
+      if (blocked) {
+        starts[k] = dead_state;
+        continue;
+      }
+    }
+
+    size_t idx;
+    if (!dstates.find(set, idx)) {
+      if (!dstates.add(set)) {
+        return false;
+      }
+
+      idx = dstates.size() - 1;
+    }
+
+    starts[k] = idx + 1;
+  }
+
+  return true;
+}
+
+bool lex::dfa::closure(const position_set* s, size_t next, state& c) const
+{
+  c.clear();
+
+  if (!c.add(*s)) {
+    return false;
+  }
+
+  // Context of the previous byte (the marker is the last position).
+  size_t prev = line_break;
+  if ((s->size > 0) && (s->data[s->size - 1] >= _M_npositions)) {
+    prev = s->data[s->size - 1] - _M_npositions;
+  }
+
+  // Add the followpos of the assertions which hold until no position is
+  // added.
+  size_t size;
+  do {
+    size = c.size();
+
+    for (size_t i = 0; i < c.size(); i++) {
+      position p = c.get(i);
+
+      if ((p < _M_npositions) &&
+          (_M_assertions[p]) &&
+          (holds(_M_assertions[p], prev, next))) {
+        if (!c.add(*_M_followpos[p])) {
+          return false;
+        }
+      }
+    }
+  } while (c.size() != size);
+
+  return true;
+}
+
+bool lex::dfa::accept_contexts(const position_set* s,
+                               state& c,
+                               uint8_t& mask,
+                               bool& blocked) const
+{
+  mask = 0;
+  blocked = true;
+
+  for (size_t n = 0; n < ncontexts; n++) {
+    if (!closure(s, n, c)) {
+      return false;
+    }
+
+    if (c.contains(_M_npositions - 1)) {
+      mask |= (1 << n);
+    }
+
+    for (size_t i = 0; (i < c.size()) && (blocked); i++) {
+      position p = c.get(i);
+      if ((p < _M_npositions) && (!_M_assertions[p])) {
+        blocked = false;
+      }
+    }
+  }
+
+  return true;
+}
+
+bool lex::dfa::relayout(const uint64_t* visits)
+{
+  if (_M_nstates == 0) {
+    return false;
+  }
+
+  bool* accept;
+  if ((accept = new (std::nothrow) bool[_M_nstates]) != nullptr) {
+    for (size_t i = 0; i < _M_nstates; i++) {
+      accept[i] = accepting(i);
+    }
+
+    bool ret = layout(accept, visits);
+
+    delete [] accept;
+
+    return ret;
+  }
+
+  return false;
+}
+
+bool lex::dfa::load(void* mapping, size_t size, size_t offset)
+{
+  if (!compiled_dfa::load(mapping, size, offset)) {
+    return false;
+  }
+
+  shrink();
+
+  _M_npositions = 0;
+
+  return true;
+}
+
+lex::compiled_dfa lex::dfa::freeze()
+{
+  shrink();
+
+  return compiled_dfa(std::move(*this));
+}
+
+void lex::dfa::shrink()
+{
+  _M_transition_table.clear();
+  _M_pool.clear();
+  _M_sets.clear();
+}
+
+void lex::dfa::print() const
+{
+  // With assertions, the sets of positions contain context markers and the
+  // accepting states depend on the next byte: print the frozen table.
+  if ((!_M_transition_table.empty()) && (!_M_accept)) {
+    _M_transition_table.print(_M_npositions - 1);
+    return;
+  }
+
+  // The DFA has not been built from a syntax tree: print the frozen table.
+  compiled_dfa::print();
+}
+
+bool lex::dfa::build_trie(const char* const* literals, size_t count)
+{
+  release_accept();
+
+  _M_unanchored = false;
+
+  // Byte classes: one per byte which appears in the literals.
+  for (size_t i = 0; i < ARRAY_SIZE(_M_classes); i++) {
+    _M_classes[i] = 0;
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    for (const uint8_t* c = reinterpret_cast<const uint8_t*>(literals[i]);
+         *c;
+         c++) {
+      _M_classes[*c] = 1;
+    }
+  }
+
+  _M_nclasses = 1;
+
+  for (size_t i = 0; i < ARRAY_SIZE(_M_classes); i++) {
+    if (_M_classes[i]) {
+      _M_classes[i] = _M_nclasses++;
+    }
+  }
+
+  // State 0 is the dead state, state 1 is the root of the trie.
+  size_t rows = 0;
+  if (!allocate_rows(2, rows)) {
+    return false;
+  }
+
+  for (size_t i = 0; i < 2 * _M_nclasses; i++) {
+    _M_dtran[i] = dead_state;
+  }
+
+  _M_nstates = 2;
+  _M_start = 1;
+
+  bool* accept;
+  size_t size = rows;
+  if ((accept = static_cast<bool*>(calloc(size, sizeof(bool)))) == nullptr) {
+    return false;
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    state_id s = _M_start;
+
+    for (const uint8_t* c = reinterpret_cast<const uint8_t*>(literals[i]);
+         *c;
+         c++) {
+      state_id* t = _M_dtran + (s * _M_nclasses) + _M_classes[*c];
+
+      if (*t == dead_state) {
+        // Add new node to the trie.
+        if (!allocate_rows(_M_nstates + 1, rows)) {
+          free(accept);
+          return false;
+        }
+
+        if (rows > size) {
+          bool* tmpaccept;
+          if ((tmpaccept = static_cast<bool*>(
+                             realloc(accept, rows * sizeof(bool))
+                           )) == nullptr) {
+            free(accept);
+            return false;
+          }
+
+          accept = tmpaccept;
+
+          memset(accept + size, 0, (rows - size) * sizeof(bool));
+          size = rows;
+        }
+
+        state_id* row = _M_dtran + (_M_nstates * _M_nclasses);
+        for (size_t j = 0; j < _M_nclasses; j++) {
+          row[j] = dead_state;
+        }
+
+        // The table might have been reallocated.
+        t = _M_dtran + (s * _M_nclasses) + _M_classes[*c];
+        *t = _M_nstates++;
+      }
+
+      s = *t;
+    }
+
+    accept[s] = true;
+  }
+
+  bool ret = layout(accept, nullptr);
+
+  free(accept);
+
+  return ret;
+}
+
+bool lex::dfa::unite(const dfa& a, const dfa& b)
+{
+  // The accepting states of the union would depend on the next byte.
+  if ((a._M_accept) || (b._M_accept)) {
+    return false;
+  }
+
+  release_accept();
+
+  _M_unanchored = false;
+
+  // Byte classes: one per pair of classes of a and b. The pair (0, 0) (bytes
+  // which appear neither in a nor in b) is class 0.
+  std::unordered_map<uint32_t, uint16_t> classes;
+  classes[0] = 0;
+
+  uint8_t representative[ARRAY_SIZE(_M_classes)];
+  representative[0] = 0;
+
+  for (size_t i = 0; i < ARRAY_SIZE(_M_classes); i++) {
+    uint32_t key = (static_cast<uint32_t>(a._M_classes[i]) << 16) |
+                   b._M_classes[i];
+
+    auto it = classes.find(key);
+    if (it != classes.end()) {
+      _M_classes[i] = it->second;
+    } else {
+      _M_classes[i] = classes.size();
+      representative[_M_classes[i]] = i;
+
+      classes[key] = _M_classes[i];
+    }
+  }
+
+  _M_nclasses = classes.size();
+
+  // States: pairs of states of a and b. The pair (dead, dead) is the dead
+  // state.
+  std::unordered_map<uint64_t, state_id> ids;
+  std::vector<uint64_t> pairs;
+
+  ids[0] = dead_state;
+  pairs.push_back(0);
+
+  uint64_t start = (static_cast<uint64_t>(a._M_start) << 32) | b._M_start;
+  if (start != 0) {
+    ids[start] = pairs.size();
+    pairs.push_back(start);
+  }
+
+  _M_start = ids[start];
+
+  size_t rows = 0;
+
+  for (size_t i = 0; i < pairs.size(); i++) {
+    if (!allocate_rows(i + 1, rows)) {
+      return false;
+    }
+
+    state_id sa = pairs[i] >> 32;
+    state_id sb = pairs[i] & 0xffffffff;
+
+    for (size_t j = 0; j < _M_nclasses; j++) {
+      uint8_t c = representative[j];
+
+      uint64_t target = (static_cast<uint64_t>(a.next(sa, c)) << 32) |
+                        b.next(sb, c);
+
+      auto it = ids.find(target);
+      if (it != ids.end()) {
+        _M_dtran[(i * _M_nclasses) + j] = it->second;
+      } else {
+        state_id id = pairs.size();
+
+        ids[target] = id;
+        pairs.push_back(target);
+
+        _M_dtran[(i * _M_nclasses) + j] = id;
+      }
+    }
+  }
+
+  _M_nstates = pairs.size();
+
+  bool* accept;
+  if ((accept = new (std::nothrow) bool[_M_nstates]) != nullptr) {
+    for (size_t i = 0; i < _M_nstates; i++) {
+      accept[i] = (a.accepting(pairs[i] >> 32)) ||
+                  (b.accepting(pairs[i] & 0xffffffff));
+    }
+
+    bool ret = layout(accept, nullptr);
+
+    delete [] accept;
+
+    return ret;
+  }
+
+  return false;
+}
+
+bool lex::dfa::allocate_rows(size_t nrows, size_t& capacity)
+{
+  if (nrows <= capacity) {
+    return true;
+  }
+
+  size_t size = (capacity > 0) ? (capacity * 2) : 32;
+  while (size < nrows) {
+    size *= 2;
+  }
+
+  // A mapped table (see load()) is not reused.
+  state_id* dtran;
+  if ((dtran = static_cast<state_id*>(
+                 realloc(_M_mapping ? nullptr : _M_dtran,
+                         size * _M_nclasses * sizeof(state_id))
+               )) != nullptr) {
+    if (_M_mapping) {
+      release_table();
+    }
+
+    _M_dtran = dtran;
+    capacity = size;
+
+    return true;
+  }
+
+  return false;
+}
+
+bool lex::dfa::layout(const bool* accept, const uint64_t* visits)
+{
+  bool* live;
+  if ((live = new (std::nothrow) bool[_M_nstates]) == nullptr) {
+    return false;
+  }
+
+  bool* always;
+  if ((always = new (std::nothrow) bool[_M_nstates]) == nullptr) {
+    delete [] live;
+    return false;
+  }
+
+  find_always_accepting(accept, always);
+
+  state_id* order;
+  if ((order = new (std::nothrow) state_id[_M_nstates]) != nullptr) {
+    size_t count;
+    bool ret = ((find_live_states(accept, live)) &&
+                (order_states(accept, always, live, visits, order, count)) &&
+                (renumber(accept, always, order, count)));
+
+    delete [] order;
+    delete [] always;
+    delete [] live;
+
+    return ret;
+  }
+
+  delete [] always;
+  delete [] live;
+
+  return false;
+}
+
+bool lex::dfa::find_live_states(const bool* accept, bool* live) const
+{
+  // Predecessors of each state: preds[first[s], first[s + 1]).
+  size_t* first;
+  if ((first = new (std::nothrow) size_t[_M_nstates + 1]) == nullptr) {
+    return false;
+  }
+
+  for (size_t i = 0; i <= _M_nstates; i++) {
+    first[i] = 0;
+  }
+
+  for (size_t i = _M_nclasses; i < _M_nstates * _M_nclasses; i++) {
+    first[_M_dtran[i] + 1]++;
+  }
+
+  for (size_t i = 0; i < _M_nstates; i++) {
+    first[i + 1] += first[i];
+  }
+
+  state_id* preds;
+  if ((preds = new (std::nothrow) state_id[first[_M_nstates]]) == nullptr) {
+    delete [] first;
+    return false;
+  }
+
+  // The stack of the search holds at most every state once.
+  state_id* stack;
+  if ((stack = new (std::nothrow) state_id[_M_nstates]) == nullptr) {
+    delete [] preds;
+    delete [] first;
+    return false;
+  }
+
+  // Fill the predecessors (the transitions of the dead state are skipped).
+  for (size_t i = 1; i < _M_nstates; i++) {
+    const state_id* row = _M_dtran + (i * _M_nclasses);
+
+    for (size_t j = 0; j < _M_nclasses; j++) {
+      preds[first[row[j]]++] = i;
+    }
+  }
+
+  // first[s] is now the end of the predecessors of s.
+  for (size_t i = _M_nstates; i > 0; i--) {
+    first[i] = first[i - 1];
+  }
+
+  first[0] = 0;
+
+  // Backward search from the accepting states.
+  size_t n = 0;
+
+  for (size_t i = 0; i < _M_nstates; i++) {
+    if ((live[i] = accept[i]) == true) {
+      stack[n++] = i;
+    }
+  }
+
+  while (n > 0) {
+    state_id s = stack[--n];
+
+    for (size_t i = first[s]; i < first[s + 1]; i++) {
+      if (!live[preds[i]]) {
+        live[preds[i]] = true;
+        stack[n++] = preds[i];
+      }
+    }
+  }
+
+  delete [] stack;
+  delete [] preds;
+  delete [] first;
+
+  return true;
+}
+
+void lex::dfa::find_always_accepting(const bool* accept, bool* always) const
+{
+  // Only the classes of some byte count (e.g. class 0 has no bytes if every
+  // byte appears in the regular expression).
+  uint16_t classes[ARRAY_SIZE(_M_classes)];
+  memcpy(classes, _M_classes, sizeof(classes));
+
+  std::sort(classes, classes + ARRAY_SIZE(classes));
+  size_t nclasses = std::unique(classes, classes + ARRAY_SIZE(classes)) -
+                    classes;
+
+  // Start from the states which accept in any context and remove the ones
+  // with a transition out of the set until it doesn't change.
+  for (size_t i = 0; i < _M_nstates; i++) {
+    always[i] = (accept[i]) &&
+                ((!_M_accept) || (_M_accept[i] == (1u << ncontexts) - 1));
+  }
+
+  bool changed;
+  do {
+    changed = false;
+
+    for (size_t i = 0; i < _M_nstates; i++) {
+      if (always[i]) {
+        const state_id* row = _M_dtran + (i * _M_nclasses);
+
+        for (size_t j = 0; j < nclasses; j++) {
+          if (!always[row[classes[j]]]) {
+            always[i] = false;
+            changed = true;
+
+            break;
+          }
+        }
+      }
+    }
+  } while (changed);
+}
+
+bool lex::dfa::order_states(const bool* accept,
+                            const bool* always,
+                            const bool* live,
+                            const uint64_t* visits,
+                            state_id* order,
+                            size_t& count) const
+{
+  // rank[s] is the position of the state s in BFS order from the start
+  // state.
+  size_t* rank;
+  if ((rank = new (std::nothrow) size_t[_M_nstates]) == nullptr) {
+    return false;
+  }
+
+  bool* placed;
+  if ((placed = new (std::nothrow) bool[_M_nstates]) == nullptr) {
+    delete [] rank;
+    return false;
+  }
+
+  // The states which can't reach an accepting state are merged into the
+  // dead state.
+  for (size_t i = 0; i < _M_nstates; i++) {
+    placed[i] = !live[i];
+  }
+
+  // Use 'order' as the BFS queue (with assertions, every start state is a
+  // root).
+  size_t n = 0;
+  placed[dead_state] = true;
+
+  if (!placed[_M_start]) {
+    order[n++] = _M_start;
+    placed[_M_start] = true;
+  }
+
+  if (_M_accept) {
+    for (size_t k = 0; k < ncontexts; k++) {
+      if (!placed[_M_starts[k]]) {
+        order[n++] = _M_starts[k];
+        placed[_M_starts[k]] = true;
+      }
+    }
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    const state_id* row = _M_dtran + (order[i] * _M_nclasses);
+
+    for (size_t j = 0; j < _M_nclasses; j++) {
+      if (!placed[row[j]]) {
+        order[n++] = row[j];
+        placed[row[j]] = true;
+      }
+    }
+  }
+
+  // Unreachable states (if any) go last.
+  for (size_t i = 1; i < _M_nstates; i++) {
+    if (!placed[i]) {
+      order[n++] = i;
+      placed[i] = true;
+    }
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    rank[order[i]] = i;
+  }
+
+  if (visits) {
+    // Sort the states by number of visits (hottest first).
+    auto hotter = [visits, rank](state_id a, state_id b) {
+      return (visits[a] != visits[b]) ? (visits[a] > visits[b]) :
+                                        (rank[a] < rank[b]);
+    };
+
+    std::sort(order, order + n, hotter);
+
+    state_id* hot;
+    if ((hot = new (std::nothrow) state_id[n]) == nullptr) {
+      delete [] placed;
+      delete [] rank;
+      return false;
+    }
+
+    memcpy(hot, order, n * sizeof(state_id));
+
+    for (size_t i = 1; i < _M_nstates; i++) {
+      placed[i] = !live[i];
+    }
+
+    // Place each hot state followed by its visited successors (hottest
+    // first).
+    size_t m = 0;
+    for (size_t i = 0; i < n; i++) {
+      if (!placed[hot[i]]) {
+        order[m++] = hot[i];
+        placed[hot[i]] = true;
+
+        const state_id* row = _M_dtran + (hot[i] * _M_nclasses);
+        size_t first = m;
+
+        for (size_t j = 0; j < _M_nclasses; j++) {
+          if ((!placed[row[j]]) && (visits[row[j]] > 0)) {
+            order[m++] = row[j];
+            placed[row[j]] = true;
+          }
+        }
+
+        std::sort(order + first, order + m, hotter);
+      }
+    }
+
+    delete [] hot;
+  }
+
+  delete [] placed;
+  delete [] rank;
+
+  // Stable partition: dead state, non-accepting states, accepting states,
+  // always-accepting states.
+  state_id* tmp;
+  if ((tmp = new (std::nothrow) state_id[_M_nstates]) == nullptr) {
+    return false;
+  }
+
+  size_t m = 0;
+  tmp[m++] = dead_state;
+
+  for (size_t i = 0; i < n; i++) {
+    if (!accept[order[i]]) {
+      tmp[m++] = order[i];
+    }
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    if ((accept[order[i]]) && (!always[order[i]])) {
+      tmp[m++] = order[i];
+    }
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    if (always[order[i]]) {
+      tmp[m++] = order[i];
+    }
+  }
+
+  memcpy(order, tmp, m * sizeof(state_id));
+  count = m;
+
+  delete [] tmp;
+
+  return true;
+}
+
+bool lex::dfa::renumber(const bool* accept,
+                        const bool* always,
+                        const state_id* order,
+                        size_t count)
+{
+  // id[old] = new (the states which are not in 'order' are dead).
+  state_id* id;
+  if ((id = new (std::nothrow) state_id[_M_nstates]) == nullptr) {
+    return false;
+  }
+
+  state_id* dtran;
+  if ((dtran = static_cast<state_id*>(
+                 malloc(count * _M_nclasses * sizeof(state_id))
+               )) == nullptr) {
+    delete [] id;
+    return false;
+  }
+
+  // Accepting contexts (if any).
+  uint8_t* masks = nullptr;
+  if ((_M_accept) &&
+      ((masks = static_cast<uint8_t*>(malloc(count))) == nullptr)) {
+    free(dtran);
+    delete [] id;
+    return false;
+  }
+
+  for (size_t i = 0; i < _M_nstates; i++) {
+    id[i] = dead_state;
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    id[order[i]] = i;
+  }
+
+  _M_first_accepting = count;
+  _M_first_always_accepting = count;
+
+  for (size_t i = 0; i < count; i++) {
+    const state_id* from = _M_dtran + (order[i] * _M_nclasses);
+    state_id* to = dtran + (i * _M_nclasses);
+
+    for (size_t j = 0; j < _M_nclasses; j++) {
+      to[j] = id[from[j]];
+    }
+
+    if ((accept[order[i]]) && (i < _M_first_accepting)) {
+      _M_first_accepting = i;
+    }
+
+    if ((always[order[i]]) && (i < _M_first_always_accepting)) {
+      _M_first_always_accepting = i;
+    }
+
+    if (masks) {
+      masks[i] = _M_accept[order[i]];
+    }
+  }
+
+  _M_start = id[_M_start];
+
+  if (masks) {
+    for (size_t k = 0; k < ncontexts; k++) {
+      _M_starts[k] = id[_M_starts[k]];
+    }
+  }
+
+  release_table();
+  _M_dtran = dtran;
+  _M_nstates = count;
+  _M_accept = masks;
+
+  delete [] id;
+
+  return true;
+}
@@ -1,11 +1,17 @@
 #ifndef LEX_DFA_H
 #define LEX_DFA_H
 
+#include <stdint.h>
+#include "lex/compiled_dfa.h"
 #include "lex/regular_expression.h"
+#include "lex/state.h"
 #include "lex/transition_table.h"
 
 namespace lex {
-  class dfa {
+  // DFA builder: it converts regular expressions (and lists of literals) to
+  // frozen DFAs. The DFA can be used in place or moved out to an immutable
+  // compiled_dfa by freeze().
+  class dfa : public compiled_dfa {
     public:
       // Constructor.
       dfa();
@@ -14,12 +20,74 @@ namespace lex {
       ~dfa();
 
       // Build DFA.
-      bool build(const regular_expression& regex);
+      // If 'st' is not null, the statistics of the construction are saved in
+      // it.
+      bool build(const regular_expression& regex, stats* st = nullptr);
+
+      // Build the unanchored DFA: it restarts at every byte, so it is in an
+      // accepting state after reading the byte at offset i iff a match ends
+      // at i + 1 (see compiled_dfa::is_match()).
+      bool build_unanchored(const regular_expression& regex,
+                            stats* st = nullptr);
+
+      // Build the reverse DFA: it recognizes the reversed strings of the
+      // language (it reads the input backward). It is built from the same
+      // syntax tree, with firstpos and lastpos swapped and followpos
+      // inverted. If 'unanchored' is true, the DFA restarts at every byte:
+      // scanning the input backward from its end, it is in an accepting
+      // state after reading the byte at offset i iff a match starts at i
+      // (see compiled_dfa::search()).
+      bool build_reverse(const regular_expression& regex,
+                         bool unanchored = false,
+                         stats* st = nullptr);
+
+      // Build DFA from a list of literals (NUL-terminated strings), which are
+      // inserted into a prefix-shared trie directly in the frozen format
+      // (without going through positions). If 'regex' is not null, the
+      // resulting DFA recognizes the literals and the regular expression.
+      bool build(const char* const* literals,
+                 size_t count,
+                 const regular_expression* regex = nullptr,
+                 stats* st = nullptr);
+
+      // Set the number of threads of the subset construction (0: one per
+      // hardware thread). The DFA does not depend on the number of threads.
+      void set_threads(size_t nthreads);
+
+      // Load a frozen DFA (see compiled_dfa::load()).
+      bool load(void* mapping, size_t size, size_t offset);
+
+      // Move the frozen DFA out of the builder, which is left empty.
+      compiled_dfa freeze();
+
+      // Release the sets of positions of the states, which are only needed
+      // by print() (the frozen transition table is kept).
+      void shrink();
+
+      // Renumber the states for cache locality.
+      // If 'visits' is not null, it must point to number_states() counters
+      // (indexed by the current state ids) collected on a sample corpus: the
+      // hottest states are placed first, each one followed by its visited
+      // successors. Otherwise, the states are ordered by BFS depth from the
+      // start state.
+      // In both cases, the dead state keeps the id 0, the accepting states
+      // are moved to the range [first_accepting_state(), number_states())
+      // and the always-accepting states to the end of it.
+      // The states which can't reach an accepting state (e.g. after the 'a'
+      // of "a$b") are merged into the dead state, so the matching stops as
+      // soon as it enters one of them.
+      bool relayout(const uint64_t* visits = nullptr);
 
       // Print.
       void print() const;
 
     private:
+      // Minimum number of states to process in parallel.
+      static const size_t min_parallel_states = 64;
+
+      // Maximum number of states whose successors are computed at once.
+      static const size_t max_batch_states = 4096;
+
       // Number of positions.
       size_t _M_npositions;
 
@@ -28,34 +96,201 @@ namespace lex {
       // such that for some i, there is a way to explain the membership of x in
       // L((r)#) by matching ai to position p of the syntax tree and ai+1 to
       // position q.
-      positions* _M_followpos;
+      // The sets are interned: the positions with the same followpos share it.
+      const position_set** _M_followpos;
+
+      // Arena for the data which is only used while building the DFA.
+      arena _M_arena;
 
-      // Transition table.
+      // Interned sets of positions (followpos sets and DFA states). They are
+      // kept after the construction for the transition table.
+      arena _M_sets;
+      position_pool _M_pool;
+
+      // Transition table (with the sets of positions of the states).
       transition_table _M_transition_table;
 
+      // Number of threads of the subset construction.
+      size_t _M_nthreads;
+
+      // Set of positions added to every state in an unanchored DFA (null
+      // otherwise).
+      const position_set* _M_restart;
+
+      // Kind of the assertion of each position ('^', '$', 'b', 'B', or 0 if
+      // the position is not an assertion), null if the regular expression
+      // has no assertions. In the reverse DFA, '^' and '$' are swapped.
+      //
+      // The assertions are resolved when the next byte is read: a state
+      // whose set contains assertions also contains the context marker
+      // _M_npositions + k, where k is the context of the previous byte.
+      // Before reading a byte, the followpos of the assertions which hold
+      // are added to the set (see closure()).
+      uint8_t* _M_assertions;
+
+      // U = union of followpos(p) for the positions p of a state which
+      // correspond to a symbol (the positions are sorted).
+      struct successor {
+        const position* data;
+        size_t size;
+        size_t hash;
+      };
+
       // Compute followpos.
-      bool compute_followpos(const node* n);
+      static bool compute_followpos(const regular_expression& regex,
+                                    positions* followpos);
+
+      // Build DFA (or reverse DFA).
+      bool construct(const regular_expression& regex,
+                     bool reverse,
+                     bool unanchored,
+                     stats* st);
+
+      // Replace followpos by its inverse, precedepos (the sets are allocated
+      // from the arena).
+      bool invert_followpos(const regular_expression& regex,
+                            arena& a,
+                            positions*& followpos) const;
+
+      // Intern the followpos sets.
+      bool intern_followpos(const positions* followpos);
 
       // Construct Dstates, the set of states of DFA D, and Dtran, the
-      // transition function for D.
-      bool construct_transition_function(const regular_expression& regex);
+      // transition function for D, from the initial state 'initial'.
+      bool construct_transition_function(const regular_expression& regex,
+                                         position_set* initial,
+                                         bool unanchored);
+
+      // Get the number of threads of the subset construction.
+      size_t number_threads() const;
+
+      // Compute the successors of the states [first, last) of Dstates for
+      // every symbol (successors[(s - first) * nsymbols + a]). The positions
+      // are allocated from the arenas and U is computed in the scratch
+      // states (one of each per thread).
+      bool compute_successors(const regular_expression& regex,
+                              const states& dstates,
+                              size_t first,
+                              size_t last,
+                              arena* arenas,
+                              state* scratch,
+                              successor* successors) const;
+
+      // Compute the successors of a state.
+      bool compute_successors(const regular_expression& regex,
+                              const position_set* s,
+                              state& u,
+                              arena& a,
+                              successor* successors) const;
+
+      // Add the initial states (one per context of the previous byte if
+      // 'initial' contains assertions) to Dstates and save their ids
+      // (dead_state if no match can start in the context).
+      bool add_initial_states(position_set* initial,
+                              states& dstates,
+                              state_id* starts);
+
+      // Does the assertion of kind 'kind' hold between a byte of context
+      // 'prev' and a byte of context 'next'?
+      static bool holds(uint8_t kind, size_t prev, size_t next);
+
+      // Does the set contain assertions?
+      bool has_assertions(const position* data, size_t size) const;
+
+      // Compute the positions of the state 's' which are reachable before a
+      // byte of context 'next': its positions plus the followpos of the
+      // assertions which hold.
+      bool closure(const position_set* s, size_t next, state& c) const;
+
+      // Compute the contexts of the next byte in which the state 's' is
+      // accepting (bit mask) and whether it has positions which can match.
+      bool accept_contexts(const position_set* s,
+                           state& c,
+                           uint8_t& mask,
+                           bool& blocked) const;
+
+      // Build trie.
+      bool build_trie(const char* const* literals, size_t count);
+
+      // Build the union of two DFAs (product construction).
+      bool unite(const dfa& a, const dfa& b);
+
+      // Make room for 'nrows' rows in the frozen table.
+      bool allocate_rows(size_t nrows, size_t& capacity);
+
+      // Order the states and renumber them.
+      bool layout(const bool* accept, const uint64_t* visits);
+
+      // Find the always-accepting states: the greatest set of states which
+      // accept in any context and whose transitions stay in the set.
+      void find_always_accepting(const bool* accept, bool* always) const;
+
+      // Find the states which can reach an accepting state.
+      bool find_live_states(const bool* accept, bool* live) const;
+
+      // Compute the order of the states which are kept (the live ones) and
+      // save their number in 'count'.
+      bool order_states(const bool* accept,
+                        const bool* always,
+                        const bool* live,
+                        const uint64_t* visits,
+                        state_id* order,
+                        size_t& count) const;
+
+      // Renumber the states following 'order' (its first 'count' states);
+      // the other states become the dead state.
+      bool renumber(const bool* accept,
+                    const bool* always,
+                    const state_id* order,
+                    size_t count);
   };
 
   inline dfa::dfa()
-    : _M_followpos(nullptr)
+    : _M_npositions(0),
+      _M_followpos(nullptr),
+      _M_pool(&_M_sets),
+      _M_nthreads(1),
+      _M_restart(nullptr),
+      _M_assertions(nullptr)
   {
   }
 
   inline dfa::~dfa()
   {
-    if (_M_followpos) {
-      delete [] _M_followpos;
+  }
+
+  inline void dfa::set_threads(size_t nthreads)
+  {
+    _M_nthreads = nthreads;
+  }
+
+  inline bool dfa::holds(uint8_t kind, size_t prev, size_t next)
+  {
+    switch (kind) {
+      case '^':
+        return (prev == line_break);
+      case '$':
+        return (next == line_break);
+      case 'b':
+        return ((prev == word) != (next == word));
+      case 'B':
+        return ((prev == word) == (next == word));
+      default:
+        return false;
     }
   }
 
-  inline void dfa::print() const
+  inline bool dfa::has_assertions(const position* data, size_t size) const
   {
-    _M_transition_table.print(_M_npositions - 1);
+    if (_M_assertions) {
+      for (size_t i = 0; i < size; i++) {
+        if ((data[i] < _M_npositions) && (_M_assertions[data[i]])) {
+          return true;
+        }
+      }
+    }
+
+    return false;
   }
 }
 
@@ -0,0 +1,406 @@
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include "lex/lazy_dfa.h"
+
+const size_t lex::lazy_dfa::default_cache_size;
+const lex::state_id lex::lazy_dfa::unknown;
+const lex::state_id lex::lazy_dfa::start_state;
+
+bool lex::lazy_dfa::build(const regular_expression& regex)
+{
+  return construct(regex, false);
+}
+
+bool lex::lazy_dfa::build_reverse(const regular_expression& regex)
+{
+  return construct(regex, true);
+}
+
+bool lex::lazy_dfa::construct(const regular_expression& regex, bool reverse)
+{
+  const node* root;
+  if (((root = regex.root()) == nullptr) || (regex.has_assertions())) {
+    return false;
+  }
+
+  size_t npositions = regex.number_positions();
+
+  // Byte classes.
+  memset(_M_classes, 0, sizeof(_M_classes));
+
+  for (size_t i = 0; i < regex.number_symbols(); i++) {
+    _M_classes[regex.get_symbol(i)] = i + 1;
+    _M_bytes[i + 1] = regex.get_symbol(i);
+  }
+
+  _M_nclasses = regex.number_symbols() + 1;
+
+  // Bytes matched by each position (the leaves with the same bytes share
+  // their bitmap, the bitmap 0 is empty: the endmark).
+  std::unordered_map<std::string, uint32_t> charsets;
+
+  _M_leaves.assign(npositions, 0);
+  _M_charsets.assign(4, 0);
+
+  for (size_t i = 0; i < regex.number_nodes(); i++) {
+    const node* n = regex.get_node(i);
+
+    uint64_t bytes[4] = {0, 0, 0, 0};
+
+    if (n->t == node::type::symbol) {
+      bytes[n->s >> 6] = static_cast<uint64_t>(1) << (n->s & 63);
+    } else if (n->t == node::type::char_class) {
+      memcpy(bytes, n->chars, sizeof(bytes));
+    } else {
+      continue;
+    }
+
+    auto res = charsets.emplace(std::string(reinterpret_cast<char*>(bytes),
+                                            sizeof(bytes)),
+                                _M_charsets.size() / 4);
+
+    if (res.second) {
+      _M_charsets.insert(_M_charsets.end(), bytes, bytes + 4);
+    }
+
+    _M_leaves[n->pos] = res.first->second;
+  }
+
+  position endmark = npositions - 1;
+
+  // followpos, or its inverse in a reverse DFA (counted first, then filled).
+  _M_first.assign(npositions + 1, 0);
+
+  for (size_t pass = 0; pass < 2; pass++) {
+    std::vector<size_t> next(_M_first.begin(), _M_first.end() - 1);
+
+    auto link = [&](position p, position q) {
+      if (reverse) {
+        std::swap(p, q);
+      }
+
+      if (pass == 0) {
+        _M_first[p + 1]++;
+      } else {
+        _M_follow[next[p]++] = q;
+      }
+    };
+
+    // In a reverse DFA, the endmark stands for the beginning, which
+    // precedes firstpos(root) (the endmark never matches a byte).
+    if (reverse) {
+      for (size_t j = 0; j < root->firstpos.size(); j++) {
+        link(endmark, root->firstpos.get(j));
+      }
+    }
+
+    for (size_t i = 0; i < regex.number_nodes(); i++) {
+      const node* n = regex.get_node(i);
+
+      const node* from;
+      const node* to;
+
+      switch (n->t) {
+        case node::type::concatenation:
+          from = n->left;
+          to = n->right;
+          break;
+        case node::type::repetition_zero_or_more:
+        case node::type::repetition_one_or_more:
+          from = n->left;
+          to = n->left;
+          break;
+        default:
+          continue;
+      }
+
+      for (size_t j = 0; j < from->lastpos.size(); j++) {
+        for (size_t k = 0; k < to->firstpos.size(); k++) {
+          link(from->lastpos.get(j), to->firstpos.get(k));
+        }
+      }
+    }
+
+    if (pass == 0) {
+      for (size_t p = 0; p < npositions; p++) {
+        _M_first[p + 1] += _M_first[p];
+      }
+
+      _M_follow.resize(_M_first[npositions]);
+    }
+  }
+
+  // The reverse DFA starts with the positions followed by the endmark.
+  if (reverse) {
+    _M_initial.assign(_M_follow.begin() + _M_first[endmark],
+                      _M_follow.begin() + _M_first[endmark + 1]);
+
+    std::sort(_M_initial.begin(), _M_initial.end());
+    _M_initial.erase(std::unique(_M_initial.begin(), _M_initial.end()),
+                     _M_initial.end());
+  } else {
+    _M_initial.assign(root->firstpos.data(),
+                      root->firstpos.data() + root->firstpos.size());
+  }
+
+  _M_endmark = endmark;
+  _M_restart = reverse;
+
+  _M_seen.assign(npositions, false);
+  _M_flushes = 0;
+
+  return flush();
+}
+
+size_t lex::lazy_dfa::explore(size_t limit)
+{
+  size_t count = limit + 1;
+  size_t flushes = _M_flushes;
+
+  if (flush()) {
+    for (state_id s = start_state; ; s++) {
+      if (_M_sets.size() - 1 > limit) {
+        break;
+      }
+
+      if (s == _M_sets.size()) {
+        count = _M_sets.size() - 1;
+        break;
+      }
+
+      for (size_t cls = 1; cls < _M_nclasses; cls++) {
+        compute(s, cls);
+      }
+
+      // The cache is too small.
+      if (_M_flushes != flushes) {
+        break;
+      }
+    }
+
+    flush();
+  }
+
+  _M_flushes = flushes;
+
+  return count;
+}
+
+bool lex::lazy_dfa::match(const void* buf, size_t len)
+{
+  const uint8_t* b = static_cast<const uint8_t*>(buf);
+
+  state_id s = start_state;
+
+  for (size_t i = 0; (i < len) && (s != compiled_dfa::dead_state); i++) {
+    s = next(s, b[i]);
+  }
+
+  return accepting(s);
+}
+
+bool lex::lazy_dfa::search(const void* buf,
+                           size_t len,
+                           size_t& start,
+                           size_t& end)
+{
+  const uint8_t* b = static_cast<const uint8_t*>(buf);
+
+  for (size_t i = 0; i <= len; i++) {
+    state_id s = start_state;
+
+    bool found;
+    if ((found = accepting(s)) == true) {
+      end = i;
+    }
+
+    for (size_t j = i; j < len; j++) {
+      if ((s = next(s, b[j])) == compiled_dfa::dead_state) {
+        break;
+      }
+
+      if (accepting(s)) {
+        found = true;
+        end = j + 1;
+      }
+    }
+
+    if (found) {
+      start = i;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool lex::lazy_dfa::search(lazy_dfa& reverse,
+                           const void* buf,
+                           size_t len,
+                           size_t& start,
+                           size_t& end)
+{
+  const uint8_t* b = static_cast<const uint8_t*>(buf);
+
+  // Backward scan (the reverse DFA restarts at every byte): leftmost start.
+  state_id s = start_state;
+
+  bool found;
+  if ((found = reverse.accepting(s)) == true) {
+    start = len;
+  }
+
+  for (size_t i = len; i-- > 0; ) {
+    if (reverse.accepting(s = reverse.next(s, b[i]))) {
+      start = i;
+      found = true;
+    }
+  }
+
+  if (!found) {
+    return false;
+  }
+
+  // Forward scan from the leftmost start: longest match.
+  s = start_state;
+
+  if (accepting(s)) {
+    end = start;
+  }
+
+  for (size_t i = start; i < len; i++) {
+    if ((s = next(s, b[i])) == compiled_dfa::dead_state) {
+      break;
+    }
+
+    if (accepting(s)) {
+      end = i + 1;
+    }
+  }
+
+  return true;
+}
+
+lex::state_id lex::lazy_dfa::compute(state_id s, size_t cls)
+{
+  uint8_t c = _M_bytes[cls];
+  const position_set* set = _M_sets[s];
+
+  // Union of the followpos sets of the positions which match 'c'.
+  _M_next.clear();
+
+  for (size_t i = 0; i < set->size; i++) {
+    position p = set->data[i];
+
+    if (matches(p, c)) {
+      for (size_t k = _M_first[p]; k < _M_first[p + 1]; k++) {
+        position q = _M_follow[k];
+
+        if (!_M_seen[q]) {
+          _M_seen[q] = true;
+          _M_next.push_back(q);
+        }
+      }
+    }
+  }
+
+  // The reverse DFA restarts at every byte.
+  if (_M_restart) {
+    for (position q : _M_initial) {
+      if (!_M_seen[q]) {
+        _M_seen[q] = true;
+        _M_next.push_back(q);
+      }
+    }
+  }
+
+  for (position q : _M_next) {
+    _M_seen[q] = false;
+  }
+
+  std::sort(_M_next.begin(), _M_next.end());
+
+  size_t h = position_pool::hash(_M_next.data(), _M_next.size());
+
+  // If the cache is full, it is flushed (and the state 's' is lost).
+  bool flushed = false;
+  if (cache_size() > _M_cache_size) {
+    if (!flush()) {
+      return compiled_dfa::dead_state;
+    }
+
+    _M_flushes++;
+    flushed = true;
+  }
+
+  state_id n;
+  if ((n = add(_M_next.data(), _M_next.size(), h)) == unknown) {
+    return compiled_dfa::dead_state;
+  }
+
+  if (!flushed) {
+    _M_dtran[(s * _M_nclasses) + cls] = n;
+  }
+
+  return n;
+}
+
+lex::state_id lex::lazy_dfa::add(const position* p, size_t count, size_t h)
+{
+  position_set* set;
+  if ((set = _M_pool.intern(p, count, h)) == nullptr) {
+    return unknown;
+  }
+
+  if (set->state == position_set::no_state) {
+    set->state = _M_sets.size();
+    _M_sets.push_back(set);
+
+    // The endmark is the last position.
+    _M_accept.push_back((count > 0) && (p[count - 1] == _M_endmark));
+
+    // Class 0 leads to the dead state (back to the start state in the
+    // reverse DFA).
+    _M_dtran.push_back(_M_restart ? start_state : compiled_dfa::dead_state);
+    _M_dtran.insert(_M_dtran.end(), _M_nclasses - 1, unknown);
+  }
+
+  return static_cast<state_id>(set->state);
+}
+
+bool lex::lazy_dfa::flush()
+{
+  _M_pool.clear();
+  _M_arena.reset();
+
+  _M_sets.clear();
+  _M_dtran.clear();
+  _M_accept.clear();
+
+  if ((add(nullptr, 0, position_pool::hash(nullptr, 0)) !=
+       compiled_dfa::dead_state) ||
+      (add(_M_initial.data(),
+           _M_initial.size(),
+           position_pool::hash(_M_initial.data(), _M_initial.size())) !=
+       start_state)) {
+    return false;
+  }
+
+  // The dead state has no way out.
+  std::fill(_M_dtran.begin(),
+            _M_dtran.begin() + _M_nclasses,
+            compiled_dfa::dead_state);
+
+  return true;
+}
+
+size_t lex::lazy_dfa::cache_size() const
+{
+  // Each set has a pointer in _M_sets and up to 4 slots in the table of the
+  // pool.
+  return _M_arena.size() +
+         (_M_dtran.size() * sizeof(state_id)) +
+         (_M_sets.size() * ((5 * sizeof(position_set*)) + 1));
+}
@@ -0,0 +1,193 @@
+#ifndef LEX_LAZY_DFA_H
+#define LEX_LAZY_DFA_H
+
+#include <stdint.h>
+#include <vector>
+#include "lex/regular_expression.h"
+#include "lex/position_set.h"
+#include "lex/compiled_dfa.h"
+
+namespace lex {
+  // Lazy DFA: the states of the DFA of dfa::build() (the sets of positions)
+  // are built on demand while matching, so only the states which the input
+  // reaches are built, and a regular expression whose DFA would explode
+  // costs at most one subset computation per byte.
+  //
+  // The states and their transitions are cached. When the cache is full, it
+  // is flushed and the matching goes on from the current state. Matching
+  // fills the cache, so a lazy DFA must not be shared between threads.
+  class lazy_dfa {
+    public:
+      // Default size of the cache (bytes).
+      static const size_t default_cache_size = 8 * 1024 * 1024;
+
+      // Constructor.
+      lazy_dfa();
+
+      // Set the size of the cache (must be called before build()).
+      void set_cache_size(size_t size);
+
+      // Build from a regular expression (without assertions). No state is
+      // built but the start state.
+      bool build(const regular_expression& regex);
+
+      // Build the unanchored reverse DFA: followpos is inverted, the endmark
+      // stands for the beginning of the regular expression and the start
+      // state is added to every state. Scanning the input backward, it is in
+      // an accepting state after reading the byte at offset i iff a match
+      // starts at i (see search(reverse, ...)).
+      bool build_reverse(const regular_expression& regex);
+
+      // Build every state reachable from the start state, unless there are
+      // more than 'limit' of them or the cache is too small. Returns the
+      // number of states (the dead state is not counted) or limit + 1. The
+      // cache is flushed.
+      size_t explore(size_t limit);
+
+      // Does the whole input match?
+      bool match(const void* buf, size_t len);
+
+      // Search the leftmost-longest match (see compiled_dfa::search()).
+      bool search(const void* buf, size_t len, size_t& start, size_t& end);
+
+      // Search the leftmost-longest match in linear time, with the reverse
+      // DFA of the same regular expression (see
+      // compiled_dfa::search(reverse, ...)).
+      bool search(lazy_dfa& reverse,
+                  const void* buf,
+                  size_t len,
+                  size_t& start,
+                  size_t& end);
+
+      // Get number of states in the cache (including the dead state).
+      size_t number_states() const;
+
+      // Get number of flushes of the cache.
+      size_t number_flushes() const;
+
+    private:
+      // Transition which hasn't been computed yet.
+      static const state_id unknown = static_cast<state_id>(-1);
+
+      // Start state (after the dead state).
+      static const state_id start_state = 1;
+
+      // Byte classes: class 0 groups the characters which don't appear in the
+      // regular expression, class i + 1 is the byte _M_bytes[i + 1].
+      uint16_t _M_classes[256];
+      uint8_t _M_bytes[257];
+      size_t _M_nclasses;
+
+      // Bytes matched by each position: index of its bitmap (4 words) in
+      // _M_charsets.
+      std::vector<uint32_t> _M_leaves;
+      std::vector<uint64_t> _M_charsets;
+
+      // followpos(p) (its inverse in the reverse DFA) is
+      // [_M_follow[_M_first[p]], _M_follow[_M_first[p + 1]]).
+      std::vector<size_t> _M_first;
+      std::vector<position> _M_follow;
+
+      // firstpos(root) (in the reverse DFA, the positions followed by the
+      // endmark).
+      std::vector<position> _M_initial;
+
+      // Endmark (in the reverse DFA, the beginning).
+      position _M_endmark;
+
+      // Is the start state added to every state (reverse DFA)?
+      bool _M_restart;
+
+      // Cache: the sets of positions of the states (interned in the pool)
+      // and their transitions.
+      arena _M_arena;
+      position_pool _M_pool;
+
+      std::vector<const position_set*> _M_sets;
+      std::vector<state_id> _M_dtran;
+
+      // Accepting states (their set contains the endmark).
+      std::vector<uint8_t> _M_accept;
+
+      size_t _M_cache_size;
+      size_t _M_flushes;
+
+      // Scratch: the next set of positions and the positions already in it.
+      std::vector<position> _M_next;
+      std::vector<bool> _M_seen;
+
+      // Does the position 'p' match the byte 'c'?
+      bool matches(position p, uint8_t c) const;
+
+      // Is the state accepting?
+      bool accepting(state_id s) const;
+
+      // Get next state.
+      state_id next(state_id s, uint8_t c);
+
+      // Build from a regular expression.
+      bool construct(const regular_expression& regex, bool reverse);
+
+      // Compute the transition of the state 's' on the class 'cls'.
+      state_id compute(state_id s, size_t cls);
+
+      // Add a state for the sorted positions 'p' whose hash is 'h' (if it
+      // doesn't exist yet). Returns unknown on error.
+      state_id add(const position* p, size_t count, size_t h);
+
+      // Flush the cache (only the dead state and the start state are kept).
+      bool flush();
+
+      // Get number of bytes used by the cache.
+      size_t cache_size() const;
+
+      // Disable copy constructor and assignment operator.
+      lazy_dfa(const lazy_dfa&) = delete;
+      lazy_dfa& operator=(const lazy_dfa&) = delete;
+  };
+
+  inline lazy_dfa::lazy_dfa()
+    : _M_nclasses(0),
+      _M_endmark(0),
+      _M_restart(false),
+      _M_pool(&_M_arena),
+      _M_cache_size(default_cache_size),
+      _M_flushes(0)
+  {
+  }
+
+  inline void lazy_dfa::set_cache_size(size_t size)
+  {
+    _M_cache_size = size;
+  }
+
+  inline size_t lazy_dfa::number_states() const
+  {
+    return _M_sets.size();
+  }
+
+  inline size_t lazy_dfa::number_flushes() const
+  {
+    return _M_flushes;
+  }
+
+  inline bool lazy_dfa::matches(position p, uint8_t c) const
+  {
+    return ((_M_charsets[(_M_leaves[p] * 4) + (c >> 6)] >> (c & 63)) & 1);
+  }
+
+  inline bool lazy_dfa::accepting(state_id s) const
+  {
+    return (_M_accept[s] != 0);
+  }
+
+  inline state_id lazy_dfa::next(state_id s, uint8_t c)
+  {
+    size_t cls = _M_classes[c];
+    state_id n = _M_dtran[(s * _M_nclasses) + cls];
+
+    return (n != unknown) ? n : compute(s, cls);
+  }
+}
+
+#endif // LEX_LAZY_DFA_H
@@ -0,0 +1,228 @@
+#include <string.h>
+#include <vector>
+#include "lex/matcher.h"
+
+const size_t lex::matcher::max_dfa_states;
+
+bool lex::matcher::compile(const char* regex, stats* st)
+{
+  regular_expression r;
+  r.set_flags(_M_flags);
+
+  if ((!r.parse(regex, st)) || (!analyze(r, _M_analysis))) {
+    return false;
+  }
+
+  engine e = (_M_forced != engine::automatic) ? _M_forced :
+                                                choose(_M_analysis);
+
+  switch (e) {
+    case engine::literal:
+      if (!_M_analysis.is_literal) {
+        return false;
+      }
+
+      break;
+    case engine::bit_parallel:
+      if ((!_M_bit_parallel.build(r)) ||
+          (!_M_reverse_bit_parallel.build_reverse(r))) {
+        return false;
+      }
+
+      break;
+    case engine::dfa:
+      if ((!_M_dfa.build(r, st)) || (!_M_reverse_dfa.build_reverse(r, true))) {
+        return false;
+      }
+
+      break;
+    case engine::lazy_dfa:
+      if ((!_M_lazy_dfa.build(r)) || (!_M_reverse_lazy_dfa.build_reverse(r))) {
+        return false;
+      }
+
+      break;
+    default:
+      return false;
+  }
+
+  _M_engine = e;
+
+  if (st) {
+    st->engine = name(e);
+    st->estimated_states = _M_analysis.estimated_states;
+  }
+
+  return true;
+}
+
+bool lex::matcher::analyze(const regular_expression& regex, analysis& a)
+{
+  const node* root;
+  if ((root = regex.root()) == nullptr) {
+    return false;
+  }
+
+  a.positions = regex.number_positions();
+  a.classes = 0;
+  a.max_class_width = 0;
+  a.assertions = regex.has_assertions();
+
+  for (size_t i = 0; i < regex.number_nodes(); i++) {
+    const node* n = regex.get_node(i);
+
+    if (n->t == node::type::char_class) {
+      size_t width = 0;
+      for (size_t j = 0; j < 4; j++) {
+        width += __builtin_popcountll(n->chars[j]);
+      }
+
+      if (width > a.max_class_width) {
+        a.max_class_width = width;
+      }
+
+      a.classes++;
+    }
+  }
+
+  // Is the regular expression (the left operand of the endmark) a sequence
+  // of bytes?
+  std::vector<const node*> stack(1, root->left);
+
+  a.is_literal = true;
+  a.literal.clear();
+
+  while ((!stack.empty()) && (a.is_literal)) {
+    const node* n = stack.back();
+    stack.pop_back();
+
+    switch (n->t) {
+      case node::type::concatenation:
+        stack.push_back(n->right);
+        stack.push_back(n->left);
+        break;
+      case node::type::group:
+        stack.push_back(n->left);
+        break;
+      case node::type::symbol:
+        a.literal += static_cast<char>(n->s);
+        break;
+      default:
+        a.is_literal = false;
+    }
+  }
+
+  if (a.literal.empty()) {
+    a.is_literal = false;
+  }
+
+  // Estimate the size of the DFA (a literal has a state per position). The
+  // exploration isn't reused: when the DFA is chosen, compile() builds its
+  // states again (so the subset construction is done twice).
+  if (a.assertions) {
+    a.estimated_states = 0;
+  } else if (a.is_literal) {
+    a.estimated_states = a.positions;
+  } else {
+    lazy_dfa d;
+    if (!d.build(regex)) {
+      return false;
+    }
+
+    a.estimated_states = d.explore(max_dfa_states);
+  }
+
+  return true;
+}
+
+lex::matcher::engine lex::matcher::choose(const analysis& a)
+{
+  // Only the DFA supports the assertions.
+  if (a.assertions) {
+    return engine::dfa;
+  }
+
+  if (a.is_literal) {
+    return engine::literal;
+  }
+
+  if (a.estimated_states <= max_dfa_states) {
+    return engine::dfa;
+  }
+
+  return (a.positions <= bit_parallel::max_positions) ?
+           engine::bit_parallel :
+           engine::lazy_dfa;
+}
+
+const char* lex::matcher::name(engine e)
+{
+  switch (e) {
+    case engine::automatic:
+      return "automatic";
+    case engine::literal:
+      return "literal";
+    case engine::bit_parallel:
+      return "bit-parallel";
+    case engine::dfa:
+      return "dfa";
+    case engine::lazy_dfa:
+      return "lazy-dfa";
+    default:
+      return "unknown";
+  }
+}
+
+bool lex::matcher::match(const void* buf, size_t len)
+{
+  switch (_M_engine) {
+    case engine::literal:
+      return ((len == _M_analysis.literal.size()) &&
+              (memcmp(buf, _M_analysis.literal.data(), len) == 0));
+    case engine::bit_parallel:
+      return _M_bit_parallel.match(buf, len);
+    case engine::dfa:
+      return _M_dfa.match(buf, len);
+    case engine::lazy_dfa:
+      return _M_lazy_dfa.match(buf, len);
+    default:
+      return false;
+  }
+}
+
+bool lex::matcher::search(const void* buf,
+                          size_t len,
+                          size_t& start,
+                          size_t& end)
+{
+  switch (_M_engine) {
+    case engine::literal:
+      {
+        const std::string& literal = _M_analysis.literal;
+
+        const uint8_t* m;
+        if ((m = static_cast<const uint8_t*>(
+                   memmem(buf, len, literal.data(), literal.size())
+                 )) == nullptr) {
+          return false;
+        }
+
+        start = m - static_cast<const uint8_t*>(buf);
+        end = start + literal.size();
+
+        return true;
+      }
+    case engine::bit_parallel:
+      return _M_bit_parallel.search(_M_reverse_bit_parallel,
+                                    buf,
+                                    len,
+                                    start,
+                                    end);
+    case engine::dfa:
+      return _M_dfa.search(_M_reverse_dfa, buf, len, start, end);
+    case engine::lazy_dfa:
+      return _M_lazy_dfa.search(_M_reverse_lazy_dfa, buf, len, start, end);
+    default:
+      return false;
+  }
+}
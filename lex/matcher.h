@@ -0,0 +1,164 @@
+#ifndef LEX_MATCHER_H
+#define LEX_MATCHER_H
+
+#include <stdint.h>
+#include <string>
+#include "lex/regular_expression.h"
+#include "lex/dfa.h"
+#include "lex/bit_parallel.h"
+#include "lex/lazy_dfa.h"
+#include "lex/stats.h"
+
+namespace lex {
+  // Analysis of a parsed regular expression (see matcher::analyze()).
+  struct analysis {
+    // Number of positions (the endmark included).
+    size_t positions;
+
+    // Number of character class leaves and number of bytes of the widest
+    // one (0 if there are none).
+    size_t classes;
+    size_t max_class_width;
+
+    // Has the regular expression assertions (^, $, \b or \B)?
+    bool assertions;
+
+    // Is the regular expression a sequence of bytes (its 'literal')?
+    bool is_literal;
+    std::string literal;
+
+    // Estimated number of states of the DFA (the dead state is not
+    // counted): the states built by a lazy DFA which explores up to
+    // matcher::max_dfa_states states (max_dfa_states + 1 if there are more,
+    // 0 if the lazy DFA can't be used: with assertions).
+    size_t estimated_states;
+
+    // Constructor.
+    analysis();
+  };
+
+  // Compile a regular expression with the cheapest engine for it:
+  // - literal: memmem() (the regular expression is a sequence of bytes).
+  // - dfa: the frozen DFA of dfa::build() (small DFAs, and the regular
+  //   expressions with assertions, which only the DFA supports).
+  // - bit_parallel: the simulation of bit_parallel (at most 64 positions,
+  //   but too many DFA states).
+  // - lazy_dfa: the DFA states are built on demand (larger regular
+  //   expressions whose DFA would explode).
+  //
+  // search() takes linear time: each engine but the literal one is built
+  // with its reverse (see compiled_dfa::search(reverse, ...)).
+  //
+  // The lazy DFA fills its cache while matching, so a matcher must not be
+  // shared between threads.
+  class matcher {
+    public:
+      enum class engine {
+        automatic,
+        literal,
+        bit_parallel,
+        dfa,
+        lazy_dfa
+      };
+
+      // Maximum estimated number of states for the DFA to be built.
+      static const size_t max_dfa_states = 4096;
+
+      // Constructor.
+      matcher();
+
+      // Set flags (see regular_expression::set_flags()).
+      void set_flags(unsigned flags);
+
+      // Force an engine (automatic by default): compile() fails if it can't
+      // be used for the regular expression.
+      void set_engine(engine e);
+
+      // Parse, analyze and compile. If 'st' is not null, the statistics
+      // (and the engine) are saved in it.
+      bool compile(const char* regex, stats* st = nullptr);
+
+      // Analyze a parsed regular expression. The estimate explores up to
+      // max_dfa_states states of a lazy DFA, which compile() doesn't reuse:
+      // a DFA which is chosen costs a second subset construction.
+      bool analyze(const regular_expression& regex, analysis& a);
+
+      // Choose the engine of an analysis.
+      static engine choose(const analysis& a);
+
+      // Get the engine in use.
+      engine used_engine() const;
+
+      // Get the analysis of the regular expression.
+      const analysis& get_analysis() const;
+
+      // Get the name of an engine.
+      static const char* name(engine e);
+
+      // Does the whole input match?
+      bool match(const void* buf, size_t len);
+
+      // Search the leftmost-longest match (see compiled_dfa::search()).
+      bool search(const void* buf, size_t len, size_t& start, size_t& end);
+
+    private:
+      unsigned _M_flags;
+
+      engine _M_forced;
+      engine _M_engine;
+
+      analysis _M_analysis;
+
+      bit_parallel _M_bit_parallel;
+      dfa _M_dfa;
+      lazy_dfa _M_lazy_dfa;
+
+      // Reverse engines (for search()).
+      bit_parallel _M_reverse_bit_parallel;
+      dfa _M_reverse_dfa;
+      lazy_dfa _M_reverse_lazy_dfa;
+
+      // Disable copy constructor and assignment operator.
+      matcher(const matcher&) = delete;
+      matcher& operator=(const matcher&) = delete;
+  };
+
+  inline analysis::analysis()
+    : positions(0),
+      classes(0),
+      max_class_width(0),
+      assertions(false),
+      is_literal(false),
+      estimated_states(0)
+  {
+  }
+
+  inline matcher::matcher()
+    : _M_flags(0),
+      _M_forced(engine::automatic),
+      _M_engine(engine::automatic)
+  {
+  }
+
+  inline void matcher::set_flags(unsigned flags)
+  {
+    _M_flags = flags;
+  }
+
+  inline void matcher::set_engine(engine e)
+  {
+    _M_forced = e;
+  }
+
+  inline matcher::engine matcher::used_engine() const
+  {
+    return _M_engine;
+  }
+
+  inline const analysis& matcher::get_analysis() const
+  {
+    return _M_analysis;
+  }
+}
+
+#endif // LEX_MATCHER_H
@@ -0,0 +1,374 @@
+#include <string.h>
+#include "lex/multi_dfa.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  #define LEX_MULTI_DFA_X86 1
+  #include <immintrin.h>
+#endif
+
+const size_t lex::multi_dfa::max_dfas;
+const size_t lex::multi_dfa::max_offset;
+const size_t lex::multi_dfa::max_shuffle_states;
+const size_t lex::multi_dfa::min_gather_dfas;
+
+#if LEX_MULTI_DFA_X86
+  // Shuffle kernel: the 16 states are bytes of a register, the next states
+  // are the bytes of the table of the input byte at the indices of the
+  // current states.
+  __attribute__((target("ssse3")))
+  static uint32_t run_shuffle(const uint8_t (*shuffle)[16],
+                              const uint8_t* accept,
+                              const uint8_t* initial,
+                              const uint8_t* b,
+                              size_t len,
+                              bool prefix)
+  {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i f = _mm_loadu_si128(reinterpret_cast<const __m128i*>(accept));
+
+    __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(initial));
+    __m128i accepted = prefix ? _mm_shuffle_epi8(f, s) : zero;
+
+    for (size_t i = 0; i < len; i++) {
+      s = _mm_shuffle_epi8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(shuffle[b[i]])),
+            s
+          );
+
+      // The unused lanes are in the dead state.
+      __m128i done = _mm_cmpeq_epi8(s, zero);
+
+      if (prefix) {
+        accepted = _mm_or_si128(accepted, _mm_shuffle_epi8(f, s));
+        done = _mm_or_si128(done, accepted);
+      }
+
+      if (_mm_movemask_epi8(done) == 0xffff) {
+        break;
+      }
+    }
+
+    if (!prefix) {
+      accepted = _mm_shuffle_epi8(f, s);
+    }
+
+    return _mm_movemask_epi8(accepted);
+  }
+
+  // Get one bit per 16-bit lane of a comparison.
+  __attribute__((target("avx2")))
+  static inline uint32_t lanes(__m256i v)
+  {
+    return _mm_movemask_epi8(_mm_packs_epi16(_mm256_castsi256_si128(v),
+                                             _mm256_extracti128_si256(v, 1)));
+  }
+
+  // Get the lanes whose state is accepting (state >= bound).
+  __attribute__((target("avx2")))
+  static inline __m256i accepting(__m256i s, __m256i bound)
+  {
+    return _mm256_cmpeq_epi16(_mm256_max_epu16(s, bound), s);
+  }
+
+  // Gather kernel: the 16 states are 16-bit offsets in the table, the class
+  // of the input byte in each DFA is added to them and the entries are
+  // gathered 8 at a time (32 bits from each 16-bit offset). If 'wide' is
+  // false, the lanes [8, 16) are unused and aren't gathered.
+  __attribute__((target("avx2")))
+  static uint32_t run_gather(const uint16_t* table,
+                             const uint16_t (*columns)[16],
+                             const uint16_t* start,
+                             const uint16_t* dead,
+                             const uint16_t* bound,
+                             const uint8_t* b,
+                             size_t len,
+                             bool wide,
+                             bool prefix)
+  {
+    const int* t = reinterpret_cast<const int*>(table);
+    const __m256i mask = _mm256_set1_epi32(0xffff);
+    const __m256i d = _mm256_loadu_si256(
+                        reinterpret_cast<const __m256i*>(dead)
+                      );
+    const __m256i a = _mm256_loadu_si256(
+                        reinterpret_cast<const __m256i*>(bound)
+                      );
+
+    __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(start));
+    __m256i accepted = prefix ? accepting(s, a) : _mm256_setzero_si256();
+
+    for (size_t i = 0; i < len; i++) {
+      __m256i index = _mm256_add_epi16(
+                        s,
+                        _mm256_loadu_si256(
+                          reinterpret_cast<const __m256i*>(columns[b[i]])
+                        )
+                      );
+
+      __m256i lo = _mm256_and_si256(
+                     _mm256_i32gather_epi32(
+                       t,
+                       _mm256_cvtepu16_epi32(_mm256_castsi256_si128(index)),
+                       2
+                     ),
+                     mask
+                   );
+
+      // The unused lanes stay in the row 0.
+      __m256i hi = _mm256_setzero_si256();
+
+      if (wide) {
+        hi = _mm256_and_si256(
+               _mm256_i32gather_epi32(
+                 t,
+                 _mm256_cvtepu16_epi32(_mm256_extracti128_si256(index, 1)),
+                 2
+               ),
+               mask
+             );
+      }
+
+      // packus interleaves the 128-bit halves of 'lo' and 'hi'.
+      s = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xd8);
+
+      __m256i done = _mm256_cmpeq_epi16(s, d);
+
+      if (prefix) {
+        accepted = _mm256_or_si256(accepted, accepting(s, a));
+        done = _mm256_or_si256(done, accepted);
+      }
+
+      if (_mm256_movemask_epi8(done) == -1) {
+        break;
+      }
+    }
+
+    if (!prefix) {
+      accepted = accepting(s, a);
+    }
+
+    return lanes(accepted);
+  }
+#endif // LEX_MULTI_DFA_X86
+
+void lex::multi_dfa::clear()
+{
+  _M_ndfas = 0;
+
+  // The row 0 (the dead state of the unused lanes) and the padding.
+  _M_table.assign(2, 0);
+
+  memset(_M_columns, 0, sizeof(_M_columns));
+  memset(_M_start, 0, sizeof(_M_start));
+  memset(_M_dead, 0, sizeof(_M_dead));
+
+  for (size_t i = 0; i < max_dfas; i++) {
+    _M_accepting[i] = max_offset;
+  }
+
+  _M_nids = 1;
+  memset(_M_shuffle, 0, sizeof(_M_shuffle));
+  memset(_M_final, 0, sizeof(_M_final));
+  memset(_M_initial, 0, sizeof(_M_initial));
+
+  choose_kernel();
+}
+
+bool lex::multi_dfa::add(const compiled_dfa& d)
+{
+  size_t nstates = d.number_states();
+  size_t nclasses = d.number_classes();
+
+  if ((_M_ndfas == max_dfas) || (nstates == 0) || (d.has_assertions())) {
+    return false;
+  }
+
+  // Without the padding.
+  size_t base = _M_table.size() - 1;
+  if (base + (nstates * nclasses) > max_offset) {
+    return false;
+  }
+
+  _M_table.resize(base);
+
+  for (state_id s = 0; s < nstates; s++) {
+    for (size_t cls = 0; cls < nclasses; cls++) {
+      _M_table.push_back(base + (d.next_by_class(s, cls) * nclasses));
+    }
+  }
+
+  _M_table.push_back(0);
+
+  size_t i = _M_ndfas;
+
+  for (unsigned c = 0; c < 256; c++) {
+    _M_columns[c][i] = d.byte_class(c);
+  }
+
+  _M_start[i] = base + (d.start_state() * nclasses);
+  _M_dead[i] = base;
+  _M_accepting[i] = base + (d.first_accepting_state() * nclasses);
+
+  // The states but the dead state get the ids [_M_nids, _M_nids + n - 1).
+  if ((_M_nids <= max_shuffle_states) &&
+      (_M_nids + nstates - 1 <= max_shuffle_states)) {
+    size_t first = _M_nids - 1;
+
+    for (state_id s = 1; s < nstates; s++) {
+      for (unsigned c = 0; c < 256; c++) {
+        state_id next = d.next_by_class(s, d.byte_class(c));
+
+        _M_shuffle[c][first + s] = (next != compiled_dfa::dead_state) ?
+                                     first + next :
+                                     0;
+      }
+
+      _M_final[first + s] = (s >= d.first_accepting_state()) ? 0xff : 0;
+    }
+
+    _M_initial[i] = (d.start_state() != compiled_dfa::dead_state) ?
+                      first + d.start_state() :
+                      0;
+  }
+
+  _M_nids += nstates - 1;
+  _M_ndfas++;
+
+  choose_kernel();
+
+  return true;
+}
+
+bool lex::multi_dfa::set_kernel(kernel k)
+{
+  if ((!supported(k)) ||
+      ((k == kernel::shuffle) && (_M_nids > max_shuffle_states))) {
+    return false;
+  }
+
+  _M_kernel = k;
+  return true;
+}
+
+const char* lex::multi_dfa::name(kernel k)
+{
+  switch (k) {
+    case kernel::scalar:
+      return "scalar";
+    case kernel::shuffle:
+      return "shuffle";
+    case kernel::gather:
+      return "gather";
+    default:
+      return "unknown";
+  }
+}
+
+void lex::multi_dfa::choose_kernel()
+{
+  // With a few DFAs, the gathers cost more than the scalar lookups.
+  if ((!set_kernel(kernel::shuffle)) &&
+      ((_M_ndfas < min_gather_dfas) || (!set_kernel(kernel::gather)))) {
+    _M_kernel = kernel::scalar;
+  }
+}
+
+uint32_t lex::multi_dfa::run(const void* buf, size_t len, bool prefix) const
+{
+  const uint8_t* b = static_cast<const uint8_t*>(buf);
+
+  uint32_t res;
+
+  switch (_M_kernel) {
+#if LEX_MULTI_DFA_X86
+    case kernel::shuffle:
+      res = run_shuffle(_M_shuffle, _M_final, _M_initial, b, len, prefix);
+      break;
+    case kernel::gather:
+      res = run_gather(_M_table.data(),
+                       _M_columns,
+                       _M_start,
+                       _M_dead,
+                       _M_accepting,
+                       b,
+                       len,
+                       _M_ndfas > 8,
+                       prefix);
+
+      break;
+#endif // LEX_MULTI_DFA_X86
+    default:
+      return run_scalar(b, len, prefix);
+  }
+
+  // Only the DFAs which have been added.
+  return res & ((static_cast<uint32_t>(1) << _M_ndfas) - 1);
+}
+
+uint32_t lex::multi_dfa::run_scalar(const uint8_t* b,
+                                    size_t len,
+                                    bool prefix) const
+{
+  const uint16_t* table = _M_table.data();
+
+  uint16_t s[max_dfas];
+  memcpy(s, _M_start, sizeof(s));
+
+  const uint32_t all = (static_cast<uint32_t>(1) << _M_ndfas) - 1;
+  uint32_t accepted = 0;
+
+  if (prefix) {
+    for (size_t k = 0; k < _M_ndfas; k++) {
+      if (s[k] >= _M_accepting[k]) {
+        accepted |= static_cast<uint32_t>(1) << k;
+      }
+    }
+  }
+
+  for (size_t i = 0; i < len; i++) {
+    const uint16_t* column = _M_columns[b[i]];
+
+    uint32_t done = accepted;
+
+    for (size_t k = 0; k < _M_ndfas; k++) {
+      s[k] = table[s[k] + column[k]];
+
+      if (s[k] == _M_dead[k]) {
+        done |= static_cast<uint32_t>(1) << k;
+      } else if ((prefix) && (s[k] >= _M_accepting[k])) {
+        accepted |= static_cast<uint32_t>(1) << k;
+        done |= static_cast<uint32_t>(1) << k;
+      }
+    }
+
+    if (done == all) {
+      break;
+    }
+  }
+
+  if (!prefix) {
+    for (size_t k = 0; k < _M_ndfas; k++) {
+      if (s[k] >= _M_accepting[k]) {
+        accepted |= static_cast<uint32_t>(1) << k;
+      }
+    }
+  }
+
+  return accepted;
+}
+
+bool lex::multi_dfa::supported(kernel k)
+{
+  switch (k) {
+    case kernel::scalar:
+      return true;
+#if LEX_MULTI_DFA_X86
+    case kernel::shuffle:
+      return __builtin_cpu_supports("ssse3");
+    case kernel::gather:
+      return __builtin_cpu_supports("avx2");
+#endif // LEX_MULTI_DFA_X86
+    default:
+      return false;
+  }
+}
@@ -0,0 +1,150 @@
+#ifndef LEX_MULTI_DFA_H
+#define LEX_MULTI_DFA_H
+
+#include <stdint.h>
+#include <vector>
+#include "lex/compiled_dfa.h"
+
+namespace lex {
+  // Multi-DFA scanner: runs up to 16 small frozen DFAs (without assertions)
+  // over the same input in a single pass, so the input is read once and the
+  // cost of each byte is shared by all the DFAs. The DFA i is the lane i of
+  // a vector of states and the bit i of the results.
+  //
+  // Kernels:
+  // - shuffle (SSSE3): if the DFAs have at most 16 states altogether (their
+  //   dead states are merged), the states are 8-bit ids and each byte costs
+  //   one pshufb in the 16-byte table of next states of the byte.
+  // - gather (AVX2): the states are 16-bit offsets of rows in a single table
+  //   of all the DFAs (at most 65535 entries), each byte adds its class in
+  //   every DFA to the offsets and fetches the next states with two 8-lane
+  //   gathers.
+  // - scalar: the same table, one DFA after the other for each byte.
+  // The shuffle kernel is chosen if possible, then the gather kernel (if
+  // there are enough DFAs for it to pay off) and the scalar kernel.
+  class multi_dfa {
+    public:
+      // Maximum number of DFAs.
+      static const size_t max_dfas = 16;
+
+      enum class kernel {
+        scalar,
+        shuffle,
+        gather
+      };
+
+      // Constructor.
+      multi_dfa();
+
+      // Clear.
+      void clear();
+
+      // Add a DFA (its transitions are copied). Returns false if there are
+      // max_dfas already, if it hasn't been built, if it has assertions or
+      // if the table would be too large.
+      bool add(const compiled_dfa& d);
+
+      // Get number of DFAs.
+      size_t size() const;
+
+      // Get the kernel in use.
+      kernel used_kernel() const;
+
+      // Force a kernel: returns false if it can't be used (the DFAs have too
+      // many states or the CPU doesn't support it).
+      bool set_kernel(kernel k);
+
+      // Get the name of a kernel.
+      static const char* name(kernel k);
+
+      // Get the mask of the DFAs which match the whole input.
+      uint32_t match(const void* buf, size_t len) const;
+
+      // Get the mask of the DFAs which accept a prefix of the input (e.g. an
+      // unanchored DFA, built from ".*(r)", accepts a prefix iff r matches
+      // anywhere in the input). The scan stops as soon as every DFA has
+      // accepted or is in its dead state.
+      uint32_t scan(const void* buf, size_t len) const;
+
+    private:
+      // Largest offset of a row (and the lower bound of the accepting rows
+      // of the unused lanes).
+      static const size_t max_offset = 0xffff;
+
+      // Maximum number of states of the shuffle kernel.
+      static const size_t max_shuffle_states = 16;
+
+      // Minimum number of DFAs for the gather kernel to be chosen.
+      static const size_t min_gather_dfas = 5;
+
+      size_t _M_ndfas;
+
+      kernel _M_kernel;
+
+      // Table of the gather and scalar kernels: the row of the state s of a
+      // DFA with n classes is at the offset base + (s * n) and each entry is
+      // the offset of the row of the next state. The row 0 is the dead
+      // state of the unused lanes, the last entry is padding (the gathers
+      // read 32 bits).
+      std::vector<uint16_t> _M_table;
+
+      // _M_columns[c][i]: class of the byte c in the DFA i.
+      uint16_t _M_columns[256][max_dfas];
+
+      // Offsets of the start state, of the dead state and of the first
+      // accepting state of each DFA.
+      uint16_t _M_start[max_dfas];
+      uint16_t _M_dead[max_dfas];
+      uint16_t _M_accepting[max_dfas];
+
+      // Shuffle kernel: the 8-bit ids of the states (0 is the dead state of
+      // every DFA), the next state of each id per byte, the accepting ids
+      // (0xff) and the start id of each DFA.
+      size_t _M_nids;
+      uint8_t _M_shuffle[256][max_shuffle_states];
+      uint8_t _M_final[max_shuffle_states];
+      uint8_t _M_initial[max_dfas];
+
+      // Choose the fastest kernel.
+      void choose_kernel();
+
+      // Run the kernel in use: if 'prefix' is true, get the mask of the DFAs
+      // which accept a prefix, otherwise the mask of the DFAs which accept
+      // the whole input.
+      uint32_t run(const void* buf, size_t len, bool prefix) const;
+
+      // Scalar kernel (the vector kernels are in multi_dfa.cpp, compiled for
+      // their instruction sets).
+      uint32_t run_scalar(const uint8_t* b, size_t len, bool prefix) const;
+
+      // Does the CPU support the kernel?
+      static bool supported(kernel k);
+  };
+
+  inline multi_dfa::multi_dfa()
+  {
+    clear();
+  }
+
+  inline size_t multi_dfa::size() const
+  {
+    return _M_ndfas;
+  }
+
+  inline multi_dfa::kernel multi_dfa::used_kernel() const
+  {
+    return _M_kernel;
+  }
+
+  inline uint32_t multi_dfa::match(const void* buf, size_t len) const
+  {
+    return run(buf, len, false);
+  }
+
+  inline uint32_t multi_dfa::scan(const void* buf, size_t len) const
+  {
+    return run(buf, len, true);
+  }
+}
+
+#endif // LEX_MULTI_DFA_H
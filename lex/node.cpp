@@ -2,14 +2,6 @@
 
 bool lex::node::init()
 {
-  // If not a leaf node...
-  if (!leaf()) {
-    // Initialize left and right children.
-    if ((!left->init()) || ((right) && (!right->init()))) {
-      return false;
-    }
-  }
-
   switch (t) {
     case type::concatenation:
       nullable = left->nullable && right->nullable;
@@ -72,8 +64,22 @@ bool lex::node::init()
         return false;
       }
 
+      break;
+    case type::group:
+      nullable = left->nullable;
+
+      if (!firstpos.add(left->firstpos)) {
+        return false;
+      }
+
+      if (!lastpos.add(left->lastpos)) {
+        return false;
+      }
+
       break;
     case type::symbol:
+    case type::char_class:
+    case type::assertion:
     case type::endmark:
       nullable = false;
 
@@ -13,18 +13,27 @@ namespace lex {
       repetition_zero_or_more, // c*
       repetition_one_or_more, // c+
       optional, // c?
+      group, // (c), capture group
       symbol,
+      char_class, // [...]
+      assertion, // ^, $, \b or \B ('s' is '^', '$', 'b' or 'B')
       endmark
     };
 
     type t;
 
     symbol s;
+
+    // Position of a leaf (number of a group node).
     position pos;
 
     node* left;
     node* right;
 
+    // Characters of a char_class leaf (bitmap of 256 bits). A char_class leaf
+    // has a single position, which corresponds to all its characters.
+    const uint64_t* chars;
+
     // nullable(n) is true for a syntax-tree node n if and only if the
     // subexpression represented by n has the empty-string in its language.
     bool nullable;
@@ -40,12 +49,13 @@ namespace lex {
     positions lastpos;
 
     // Constructor.
-    node();
-
-    // Destructor.
-    ~node();
+    // The nodes are allocated from an arena (which also holds their firstpos
+    // and lastpos), so they are not destroyed individually.
+    node(arena* a);
 
-    // Initialize.
+    // Compute nullable, firstpos and lastpos.
+    // The children must have been initialized already (the nodes are
+    // initialized in post-order).
     bool init();
 
     // Leaf node?
@@ -82,21 +92,13 @@ namespace lex {
       size_t _M_used;
   };
 
-  inline node::node()
+  inline node::node(arena* a)
     : left(nullptr),
-      right(nullptr)
-  {
-  }
-
-  inline node::~node()
+      right(nullptr),
+      chars(nullptr),
+      firstpos(a),
+      lastpos(a)
   {
-    if (left) {
-      delete left;
-    }
-
-    if (right) {
-      delete right;
-    }
   }
 
   inline bool node::leaf() const
@@ -107,8 +109,11 @@ namespace lex {
       case type::repetition_zero_or_more:
       case type::repetition_one_or_more:
       case type::optional:
+      case type::group:
         return false;
       case type::symbol:
+      case type::char_class:
+      case type::assertion:
       case type::endmark:
         return true;
       default:
@@ -126,12 +131,6 @@ namespace lex {
   inline nodes::~nodes()
   {
     if (_M_nodes) {
-      for (size_t i = 0; i < _M_used; i++) {
-        if (_M_nodes[i]) {
-          delete _M_nodes[i];
-        }
-      }
-
       free(_M_nodes);
     }
   }
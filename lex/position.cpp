@@ -6,18 +6,8 @@ bool lex::positions::add(position p)
   // If the position has not been already inserted...
   size_t idx;
   if (!search(p, idx)) {
-    if (_M_used == _M_size) {
-      size_t size = (_M_size > 0) ? (_M_size * 2) : 8;
-
-      position* tmppos;
-      if ((tmppos = static_cast<position*>(
-                      realloc(_M_positions, size * sizeof(position))
-                    )) != nullptr) {
-        _M_positions = tmppos;
-        _M_size = size;
-      } else {
-        return false;
-      }
+    if ((_M_used == _M_size) && (!reserve(_M_used + 1))) {
+      return false;
     }
 
     if (idx < _M_used) {
@@ -34,6 +24,52 @@ bool lex::positions::add(position p)
   return true;
 }
 
+bool lex::positions::add(const position* p, size_t count)
+{
+  // Count the positions which have not been inserted yet.
+  size_t n = 0;
+  for (size_t i = 0, j = 0; j < count; ) {
+    if ((i < _M_used) && (_M_positions[i] < p[j])) {
+      i++;
+    } else {
+      if ((i == _M_used) || (_M_positions[i] != p[j])) {
+        n++;
+      }
+
+      j++;
+    }
+  }
+
+  if (n == 0) {
+    return true;
+  }
+
+  if ((_M_used + n > _M_size) && (!reserve(_M_used + n))) {
+    return false;
+  }
+
+  // Merge from the end.
+  size_t i = _M_used;
+  size_t j = count;
+  size_t k = _M_used + n;
+
+  while (j > 0) {
+    if ((i > 0) && (_M_positions[i - 1] > p[j - 1])) {
+      _M_positions[--k] = _M_positions[--i];
+    } else {
+      if ((i > 0) && (_M_positions[i - 1] == p[j - 1])) {
+        i--;
+      }
+
+      _M_positions[--k] = p[--j];
+    }
+  }
+
+  _M_used += n;
+
+  return true;
+}
+
 bool lex::positions::remove(position p)
 {
   // If the position has been inserted...
@@ -51,6 +87,64 @@ bool lex::positions::remove(position p)
   return false;
 }
 
+bool lex::positions::reserve(size_t count)
+{
+  if (count <= _M_size) {
+    return true;
+  }
+
+  size_t size = _M_size * 2;
+  while (size < count) {
+    size *= 2;
+  }
+
+  position* tmppos;
+
+  if (_M_positions == _M_inline) {
+    // Move the positions out of the inline buffer.
+    if ((tmppos = static_cast<position*>(
+                    _M_arena ?
+                      _M_arena->allocate(size * sizeof(position),
+                                         alignof(position)) :
+                      malloc(size * sizeof(position))
+                  )) == nullptr) {
+      return false;
+    }
+
+    memcpy(tmppos, _M_inline, _M_used * sizeof(position));
+  } else if ((tmppos = static_cast<position*>(
+                         _M_arena ?
+                           _M_arena->reallocate(_M_positions,
+                                                _M_size * sizeof(position),
+                                                size * sizeof(position),
+                                                alignof(position)) :
+                           realloc(_M_positions, size * sizeof(position))
+                       )) == nullptr) {
+    return false;
+  }
+
+  _M_positions = tmppos;
+  _M_size = size;
+
+  return true;
+}
+
+void lex::positions::take(positions& other)
+{
+  if (other._M_positions == other._M_inline) {
+    memcpy(_M_inline, other._M_inline, other._M_used * sizeof(position));
+  } else {
+    _M_positions = other._M_positions;
+    _M_size = other._M_size;
+
+    other._M_positions = other._M_inline;
+    other._M_size = inline_capacity;
+  }
+
+  _M_used = other._M_used;
+  other._M_used = 0;
+}
+
 bool lex::positions::search(position p, size_t& idx) const
 {
   int i = 0;
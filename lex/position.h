@@ -3,18 +3,31 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include "lex/arena.h"
 
 namespace lex {
   typedef size_t position;
 
+  // Sorted set of positions. Small sets are stored inline (without
+  // allocating memory); larger ones either in the heap or in an arena.
   class positions {
     public:
+      // Number of positions stored inline.
+      static const size_t inline_capacity = 4;
+
       // Constructor.
-      positions();
+      // If 'a' is not null, the positions are allocated from the arena.
+      positions(arena* a = nullptr);
+
+      // Move constructor.
+      positions(positions&& other);
 
       // Destructor.
       ~positions();
 
+      // Move assignment operator.
+      positions& operator=(positions&& other);
+
       // Clear.
       void clear();
 
@@ -33,12 +46,18 @@ namespace lex {
       // Add positions.
       bool add(const positions& p);
 
+      // Add sorted positions.
+      bool add(const position* p, size_t count);
+
       // Remove position.
       bool remove(position p);
 
       // Get position.
       position get(size_t idx) const;
 
+      // Get the (sorted) positions.
+      const position* data() const;
+
       // Has the position been inserted?
       bool contains(position p) const;
 
@@ -50,20 +69,68 @@ namespace lex {
       size_t _M_size;
       size_t _M_used;
 
+      arena* _M_arena;
+
+      position _M_inline[inline_capacity];
+
+      // Make room for 'count' positions.
+      bool reserve(size_t count);
+
+      // Release the memory (if it has been allocated from the heap).
+      void release();
+
+      // Take the positions of another set (which is left empty).
+      void take(positions& other);
+
       // Search.
       bool search(position p, size_t& idx) const;
+
+      // Disable copy constructor and assignment operator.
+      positions(const positions&) = delete;
+      positions& operator=(const positions&) = delete;
   };
 
-  inline positions::positions()
-    : _M_positions(nullptr),
-      _M_size(0),
-      _M_used(0)
+  inline positions::positions(arena* a)
+    : _M_positions(_M_inline),
+      _M_size(inline_capacity),
+      _M_used(0),
+      _M_arena(a)
   {
   }
 
+  inline positions::positions(positions&& other)
+    : _M_positions(_M_inline),
+      _M_size(inline_capacity),
+      _M_used(0),
+      _M_arena(other._M_arena)
+  {
+    take(other);
+  }
+
   inline positions::~positions()
   {
-    if (_M_positions) {
+    release();
+  }
+
+  inline positions& positions::operator=(positions&& other)
+  {
+    if (this != &other) {
+      release();
+
+      _M_positions = _M_inline;
+      _M_size = inline_capacity;
+      _M_used = 0;
+      _M_arena = other._M_arena;
+
+      take(other);
+    }
+
+    return *this;
+  }
+
+  inline void positions::release()
+  {
+    if ((_M_positions != _M_inline) && (!_M_arena)) {
       free(_M_positions);
     }
   }
@@ -100,13 +167,7 @@ namespace lex {
 
   inline bool positions::add(const positions& p)
   {
-    for (size_t i = 0; i < p._M_used; i++) {
-      if (!add(p._M_positions[i])) {
-        return false;
-      }
-    }
-
-    return true;
+    return add(p._M_positions, p._M_used);
   }
 
   inline position positions::get(size_t idx) const
@@ -114,6 +175,11 @@ namespace lex {
     return _M_positions[idx];
   }
 
+  inline const position* positions::data() const
+  {
+    return _M_positions;
+  }
+
   inline bool positions::contains(position p) const
   {
     size_t idx;
@@ -0,0 +1,116 @@
+#include <string.h>
+#include "lex/position_set.h"
+
+void lex::position_pool::clear()
+{
+  for (size_t i = 0; i < _M_size; i++) {
+    _M_sets[i] = nullptr;
+  }
+
+  _M_used = 0;
+}
+
+lex::position_set* lex::position_pool::intern(const positions& p)
+{
+  return intern(p.data(), p.size(), hash(p.data(), p.size()));
+}
+
+lex::position_set* lex::position_pool::intern(const position* p,
+                                              size_t count,
+                                              size_t h)
+{
+  // Keep the load factor <= 1/2.
+  if ((_M_used + 1) * 2 > _M_size) {
+    if (!grow()) {
+      return nullptr;
+    }
+  }
+
+  size_t mask = _M_size - 1;
+  size_t idx = h & mask;
+
+  while (_M_sets[idx]) {
+    position_set* s = _M_sets[idx];
+
+    if ((s->hash == h) &&
+        (s->size == count) &&
+        ((count == 0) || (memcmp(s->data, p, count * sizeof(position)) == 0))) {
+      return s;
+    }
+
+    idx = (idx + 1) & mask;
+  }
+
+  // Copy the set into the arena.
+  position_set* s;
+  position* data;
+  if (((s = _M_arena->create<position_set>()) == nullptr) ||
+      ((data = static_cast<position*>(
+                 _M_arena->allocate(count * sizeof(position),
+                                    alignof(position))
+               )) == nullptr)) {
+    return nullptr;
+  }
+
+  if (count > 0) {
+    memcpy(data, p, count * sizeof(position));
+  }
+
+  s->data = data;
+  s->size = count;
+  s->hash = h;
+  s->state = position_set::no_state;
+
+  _M_sets[idx] = s;
+  _M_used++;
+
+  return s;
+}
+
+bool lex::position_pool::grow()
+{
+  size_t size = (_M_size > 0) ? (_M_size * 2) : 256;
+
+  position_set** sets;
+  if ((sets = static_cast<position_set**>(
+                calloc(size, sizeof(position_set*))
+              )) == nullptr) {
+    return false;
+  }
+
+  // Rehash.
+  size_t mask = size - 1;
+  for (size_t i = 0; i < _M_size; i++) {
+    if (_M_sets[i]) {
+      size_t idx = _M_sets[i]->hash & mask;
+      while (sets[idx]) {
+        idx = (idx + 1) & mask;
+      }
+
+      sets[idx] = _M_sets[i];
+    }
+  }
+
+  free(_M_sets);
+
+  _M_sets = sets;
+  _M_size = size;
+
+  return true;
+}
+
+size_t lex::position_pool::hash(const position* p, size_t count)
+{
+  // FNV-1a over the positions, with a final mix so the low bits (used to
+  // index the table) depend on all the positions.
+  uint64_t h = 14695981039346656037ull;
+  for (size_t i = 0; i < count; i++) {
+    h = (h ^ p[i]) * 1099511628211ull;
+  }
+
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+
+  return static_cast<size_t>(h);
+}
@@ -0,0 +1,127 @@
+#ifndef LEX_POSITION_SET_H
+#define LEX_POSITION_SET_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "lex/position.h"
+#include "lex/arena.h"
+
+namespace lex {
+  // Interned (immutable) set of positions: there is a single copy of each
+  // distinct set in its pool, so two sets are equal if and only if they are
+  // the same object.
+  struct position_set {
+    // The set is not the set of positions of a DFA state.
+    static const size_t no_state = static_cast<size_t>(-1);
+
+    // Sorted positions.
+    const position* data;
+    size_t size;
+
+    size_t hash;
+
+    // Index of the DFA state whose set of positions is this one (the sets
+    // double as the index of Dstates).
+    size_t state;
+
+    // Has the position been inserted?
+    bool contains(position p) const;
+
+    // Print.
+    void print() const;
+  };
+
+  // Pool of interned sets of positions (hash-consing).
+  class position_pool {
+    public:
+      // Constructor.
+      // The sets are allocated from the arena.
+      position_pool(arena* a);
+
+      // Destructor.
+      ~position_pool();
+
+      // Clear (the arena has to be cleared by its owner).
+      void clear();
+
+      // Get number of distinct sets.
+      size_t size() const;
+
+      // Intern set of positions: return the copy of the pool (it is created
+      // the first time).
+      position_set* intern(const positions& p);
+
+      // Intern set of sorted positions whose hash has already been computed
+      // (by hash()).
+      position_set* intern(const position* p, size_t count, size_t h);
+
+      // Compute hash.
+      static size_t hash(const position* p, size_t count);
+
+    private:
+      arena* _M_arena;
+
+      // Open addressing hash table (the size is a power of two).
+      position_set** _M_sets;
+      size_t _M_size;
+      size_t _M_used;
+
+      // Grow hash table.
+      bool grow();
+
+      // Disable copy constructor and assignment operator.
+      position_pool(const position_pool&) = delete;
+      position_pool& operator=(const position_pool&) = delete;
+  };
+
+  inline bool position_set::contains(position p) const
+  {
+    size_t i = 0;
+    size_t j = size;
+
+    while (i < j) {
+      size_t mid = (i + j) / 2;
+
+      if (data[mid] < p) {
+        i = mid + 1;
+      } else {
+        j = mid;
+      }
+    }
+
+    return ((i < size) && (data[i] == p));
+  }
+
+  inline void position_set::print() const
+  {
+    printf("(");
+
+    for (size_t i = 0; i < size; i++) {
+      printf("%s%u", (i > 0) ? ", " : "", data[i] + 1);
+    }
+
+    printf(")");
+  }
+
+  inline position_pool::position_pool(arena* a)
+    : _M_arena(a),
+      _M_sets(nullptr),
+      _M_size(0),
+      _M_used(0)
+  {
+  }
+
+  inline position_pool::~position_pool()
+  {
+    if (_M_sets) {
+      free(_M_sets);
+    }
+  }
+
+  inline size_t position_pool::size() const
+  {
+    return _M_used;
+  }
+}
+
+#endif // LEX_POSITION_SET_H
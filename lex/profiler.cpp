@@ -0,0 +1,183 @@
+#include <inttypes.h>
+#include <string.h>
+#include "lex/profiler.h"
+
+bool lex::profiler::init(const dfa& dfa)
+{
+  size_t nstates = dfa.number_states();
+  size_t ntrans = nstates * dfa.number_classes();
+
+  uint64_t* visits;
+  if ((visits = static_cast<uint64_t*>(
+                  realloc(_M_visits, nstates * sizeof(uint64_t))
+                )) != nullptr) {
+    _M_visits = visits;
+
+    uint64_t* hits;
+    if ((hits = static_cast<uint64_t*>(
+                  realloc(_M_hits, ntrans * sizeof(uint64_t))
+                )) != nullptr) {
+      _M_hits = hits;
+
+      _M_dfa = &dfa;
+
+      reset();
+
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void lex::profiler::reset()
+{
+  memset(_M_visits, 0, _M_dfa->number_states() * sizeof(uint64_t));
+
+  memset(_M_hits,
+         0,
+         _M_dfa->number_states() * _M_dfa->number_classes() *
+         sizeof(uint64_t));
+
+  _M_dead_exits = 0;
+  _M_calls = 0;
+  _M_bytes = 0;
+}
+
+bool lex::profiler::match(const void* buf, size_t len)
+{
+  const uint8_t* b = static_cast<const uint8_t*>(buf);
+
+  _M_calls++;
+
+  state_id s = _M_dfa->start_state(compiled_dfa::line_break);
+  _M_visits[s]++;
+
+  for (size_t i = 0; i < len; i++) {
+    if ((s = next(s, b[i])) == dfa::dead_state) {
+      return false;
+    }
+  }
+
+  return _M_dfa->accepting(s, compiled_dfa::line_break);
+}
+
+bool lex::profiler::search(const void* buf,
+                           size_t len,
+                           size_t& start,
+                           size_t& end)
+{
+  const uint8_t* b = static_cast<const uint8_t*>(buf);
+
+  _M_calls++;
+
+  for (size_t i = 0; i <= len; i++) {
+    state_id s = _M_dfa->start_state((i > 0) ?
+                                       compiled_dfa::context(b[i - 1]) :
+                                       compiled_dfa::line_break);
+
+    // No match can start after the previous byte.
+    if (s == dfa::dead_state) {
+      continue;
+    }
+
+    _M_visits[s]++;
+
+    bool found;
+    if ((found = _M_dfa->accepting(s, b, len, i)) == true) {
+      end = i;
+    }
+
+    for (size_t j = i; j < len; j++) {
+      if ((s = next(s, b[j])) == dfa::dead_state) {
+        break;
+      }
+
+      if (_M_dfa->accepting(s, b, len, j + 1)) {
+        end = j + 1;
+        found = true;
+      }
+    }
+
+    if (found) {
+      start = i;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+lex::state_id lex::profiler::dominant_state(double& share) const
+{
+  state_id dominant = dfa::dead_state;
+  uint64_t total = 0;
+
+  for (size_t i = 0; i < _M_dfa->number_states(); i++) {
+    total += _M_visits[i];
+
+    if (_M_visits[i] > _M_visits[dominant]) {
+      dominant = i;
+    }
+  }
+
+  share = (total > 0) ? static_cast<double>(_M_visits[dominant]) / total : 0.0;
+
+  return dominant;
+}
+
+bool lex::profiler::save(FILE* file) const
+{
+  double share;
+  state_id dominant = dominant_state(share);
+
+  fprintf(file, "{\n");
+  fprintf(file, "  \"states\": %zu,\n", _M_dfa->number_states());
+  fprintf(file, "  \"classes\": %zu,\n", _M_dfa->number_classes());
+  fprintf(file, "  \"start\": %u,\n", _M_dfa->start_state());
+  fprintf(file, "  \"first_accepting\": %u,\n",
+          _M_dfa->first_accepting_state());
+  fprintf(file, "  \"calls\": %" PRIu64 ",\n", _M_calls);
+  fprintf(file, "  \"bytes\": %" PRIu64 ",\n", _M_bytes);
+  fprintf(file, "  \"average_bytes\": %.2f,\n", average_bytes());
+  fprintf(file, "  \"dead_exits\": %" PRIu64 ",\n", _M_dead_exits);
+  fprintf(file, "  \"dominant_state\": %u,\n", dominant);
+  fprintf(file, "  \"dominant_share\": %.4f,\n", share);
+
+  // Visits per state.
+  fprintf(file, "  \"visits\": [");
+
+  for (size_t i = 0; i < _M_dfa->number_states(); i++) {
+    fprintf(file, "%s%" PRIu64, (i > 0) ? ", " : "", _M_visits[i]);
+  }
+
+  fprintf(file, "],\n");
+
+  // Transition heatmap (only the transitions which have been taken).
+  fprintf(file, "  \"transitions\": [");
+
+  bool first = true;
+  for (size_t i = 0; i < _M_dfa->number_states(); i++) {
+    for (size_t j = 0; j < _M_dfa->number_classes(); j++) {
+      uint64_t h = hits(i, j);
+
+      if (h > 0) {
+        fprintf(file,
+                "%s\n    {\"from\": %zu, \"class\": %zu, \"to\": %u, "
+                "\"hits\": %" PRIu64 "}",
+                first ? "" : ",",
+                i,
+                j,
+                _M_dfa->next_by_class(i, j),
+                h);
+
+        first = false;
+      }
+    }
+  }
+
+  fprintf(file, "%s]\n", first ? "" : "\n  ");
+  fprintf(file, "}\n");
+
+  return (ferror(file) == 0);
+}
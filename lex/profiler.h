@@ -0,0 +1,140 @@
+#ifndef LEX_PROFILER_H
+#define LEX_PROFILER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "lex/dfa.h"
+
+namespace lex {
+  // Instrumented matcher: same semantics as dfa::match() and dfa::search(),
+  // but counting visits per state, hits per transition, dead-state exits and
+  // bytes consumed. It lives in its own translation unit, so the matching
+  // methods of the DFA don't pay for the counters.
+  class profiler {
+    public:
+      // Constructor.
+      profiler();
+
+      // Destructor.
+      ~profiler();
+
+      // Initialize.
+      bool init(const dfa& dfa);
+
+      // Reset counters.
+      void reset();
+
+      // Does the whole input match?
+      bool match(const void* buf, size_t len);
+
+      // Search the leftmost-longest match.
+      bool search(const void* buf, size_t len, size_t& start, size_t& end);
+
+      // Get visits per state (indexed by state id), suitable for
+      // dfa::relayout().
+      const uint64_t* visits() const;
+
+      // Get number of hits of the transition (s, byte class).
+      uint64_t hits(state_id s, size_t cls) const;
+
+      // Get number of times the matcher entered the dead state.
+      uint64_t dead_exits() const;
+
+      // Get number of calls.
+      uint64_t calls() const;
+
+      // Get number of bytes consumed.
+      uint64_t bytes() const;
+
+      // Get average number of bytes consumed per call.
+      double average_bytes() const;
+
+      // Get the state with most visits and its share of the total.
+      state_id dominant_state(double& share) const;
+
+      // Export profile as JSON.
+      bool save(FILE* file) const;
+
+    private:
+      const dfa* _M_dfa;
+
+      uint64_t* _M_visits;
+      uint64_t* _M_hits;
+
+      uint64_t _M_dead_exits;
+      uint64_t _M_calls;
+      uint64_t _M_bytes;
+
+      // Step.
+      state_id next(state_id s, uint8_t c);
+  };
+
+  inline profiler::profiler()
+    : _M_dfa(nullptr),
+      _M_visits(nullptr),
+      _M_hits(nullptr),
+      _M_dead_exits(0),
+      _M_calls(0),
+      _M_bytes(0)
+  {
+  }
+
+  inline profiler::~profiler()
+  {
+    if (_M_visits) {
+      free(_M_visits);
+    }
+
+    if (_M_hits) {
+      free(_M_hits);
+    }
+  }
+
+  inline const uint64_t* profiler::visits() const
+  {
+    return _M_visits;
+  }
+
+  inline uint64_t profiler::hits(state_id s, size_t cls) const
+  {
+    return _M_hits[(s * _M_dfa->number_classes()) + cls];
+  }
+
+  inline uint64_t profiler::dead_exits() const
+  {
+    return _M_dead_exits;
+  }
+
+  inline uint64_t profiler::calls() const
+  {
+    return _M_calls;
+  }
+
+  inline uint64_t profiler::bytes() const
+  {
+    return _M_bytes;
+  }
+
+  inline double profiler::average_bytes() const
+  {
+    return (_M_calls > 0) ? static_cast<double>(_M_bytes) / _M_calls : 0.0;
+  }
+
+  inline state_id profiler::next(state_id s, uint8_t c)
+  {
+    size_t cls = _M_dfa->byte_class(c);
+
+    _M_hits[(s * _M_dfa->number_classes()) + cls]++;
+    _M_bytes++;
+
+    if ((s = _M_dfa->next(s, c)) != dfa::dead_state) {
+      _M_visits[s]++;
+    } else {
+      _M_dead_exits++;
+    }
+
+    return s;
+  }
+}
+
+#endif // LEX_PROFILER_H
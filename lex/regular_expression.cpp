@@ -1,49 +1,100 @@
 #include <stdint.h>
 #include <string.h>
+#include <algorithm>
 #include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 #include "lex/regular_expression.h"
+#include "lex/case_folding.h"
 #include "macros/macros.h"
 
-bool lex::regular_expression::parse(const char* regex)
+void lex::regular_expression::clear()
 {
+  _M_root = nullptr;
+
+  _M_nodes = nullptr;
+  _M_nnodes = 0;
+
+  _M_npositions = 0;
+
+  for (size_t i = 0; i < _M_nsymbols; i++) {
+    _M_symbols[i].p.clear();
+  }
+
+  _M_nsymbols = 0;
+
+  _M_expanded = 0;
+  _M_ngroups = 0;
+
+  // Keep a chunk of the arena for the next regular expression.
+  _M_arena.reset();
+}
+
+bool lex::regular_expression::has_assertions() const
+{
+  for (size_t i = 0; i < _M_nnodes; i++) {
+    if (_M_nodes[i]->t == node::type::assertion) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool lex::regular_expression::parse(const char* regex, stats* st)
+{
+  double start = st ? stats::now() : 0.0;
+
   nodes nodes;
 
+  // Numbers of the open capture groups.
+  std::vector<position> groups;
+
   bool chars[256];
   bool negated_char_class = false;
 
+  // Code points >= 0x80 of the current character class (UTF-8 mode).
+  std::vector<code_point_range> ranges;
+
   int state = 0; // Initial state.
 
-  uint8_t c;
-  uint8_t prevc = 0;
-  while ((c = *regex) != 0) {
+  uint32_t c;
+  uint32_t prevc = 0;
+  while ((c = static_cast<uint8_t>(*regex)) != 0) {
+    // In UTF-8 mode, decode multibyte characters.
+    if ((c >= 0x80) && (_M_flags & utf8) && (!decode_utf8(regex, c))) {
+      return false;
+    }
+
     switch (state) {
       case 0: // Initial state.
         switch (c) {
           case '\\':
-            if ((c = escape_character(regex[1])) != 0) {
-              regex++;
-            } else {
+            // Word boundary (\b) or not a word boundary (\B).
+            if ((regex[1] == 'b') || (regex[1] == 'B')) {
+              node* n;
+              if (((n = create_assertion(*++regex)) == nullptr) ||
+                  (!add(nodes, n, regex))) {
+                return false;
+              }
+
+              break;
+            }
+
+            if (!escape(regex, c)) {
               // Invalid escape character.
               return false;
             }
 
             // Fall through.
           default:
-            node* n;
-            if ((add(c, _M_npositions)) &&
-                ((n = new (std::nothrow) node()) != nullptr)) {
-              n->t = node::type::symbol;
-
-              n->s = c;
-              n->pos = _M_npositions++;
-
-              // Add node.
-              if (!add(nodes, n, regex)) {
-                // Node 'n' has been already deleted.
+            {
+              node* n;
+              if (((n = create_character(c)) == nullptr) ||
+                  (!add(nodes, n, regex))) {
                 return false;
               }
-            } else {
-              return false;
             }
 
             break;
@@ -53,8 +104,10 @@ bool lex::regular_expression::parse(const char* regex)
                 chars[i] = ((i != '\n') && (i != '\r'));
               }
 
+              ranges.clear();
+
               node* n;
-              if (((n = create_char_class_subtree(chars, 128)) == nullptr) ||
+              if (((n = create_char_class(chars, ranges, true)) == nullptr) ||
                   (!add(nodes, n, regex))) {
                 return false;
               }
@@ -62,7 +115,21 @@ bool lex::regular_expression::parse(const char* regex)
 
             break;
           case '[':
+            ranges.clear();
+            negated_char_class = false;
+
             state = 1; // Character class.
+            break;
+          case '^':
+          case '$':
+            {
+              node* n;
+              if (((n = create_assertion(c)) == nullptr) ||
+                  (!add(nodes, n, regex))) {
+                return false;
+              }
+            }
+
             break;
           case '*':
           case '+':
@@ -74,6 +141,10 @@ bool lex::regular_expression::parse(const char* regex)
               return false;
             }
 
+            if (_M_flags & captures) {
+              groups.push_back(++_M_ngroups);
+            }
+
             break;
           case ')':
             if (nodes.size() > 1) {
@@ -84,13 +155,27 @@ bool lex::regular_expression::parse(const char* regex)
                 if (!nodes.top()) {
                   nodes.pop();
 
+                  if (_M_flags & captures) {
+                    node* group;
+                    if ((group = _M_arena.create<node>(&_M_arena)) ==
+                        nullptr) {
+                      return false;
+                    }
+
+                    group->t = node::type::group;
+                    group->pos = groups.back();
+                    group->left = n;
+
+                    groups.pop_back();
+
+                    n = group;
+                  }
+
                   // Add node.
                   if (!add(nodes, n, regex)) {
-                    // Node 'n' has been already deleted.
                     return false;
                   }
                 } else {
-                  delete n;
                   return false;
                 }
               } else {
@@ -104,7 +189,7 @@ bool lex::regular_expression::parse(const char* regex)
           case '|':
             if (nodes.top()) {
               node* n;
-              if ((n = new (std::nothrow) node()) != nullptr) {
+              if ((n = _M_arena.create<node>(&_M_arena)) != nullptr) {
                 n->t = node::type::alternation;
 
                 n->left = nodes.top();
@@ -125,9 +210,7 @@ bool lex::regular_expression::parse(const char* regex)
       case 1: // Character class.
         switch (c) {
           case '\\':
-            if ((c = escape_character(regex[1])) != 0) {
-              regex++;
-            } else {
+            if (!escape(regex, c)) {
               // Invalid escape character.
               return false;
             }
@@ -138,7 +221,7 @@ bool lex::regular_expression::parse(const char* regex)
               chars[i] = false;
             }
 
-            chars[c] = true;
+            mark(chars, ranges, c, c, true);
 
             // Save previous character.
             prevc = c;
@@ -162,16 +245,14 @@ bool lex::regular_expression::parse(const char* regex)
       case 2: // Parsing character class.
         switch (c) {
           case '\\':
-            if ((c = escape_character(regex[1])) != 0) {
-              regex++;
-            } else {
+            if (!escape(regex, c)) {
               // Invalid escape character.
               return false;
             }
 
             // Fall through.
           default:
-            chars[c] = !negated_char_class;
+            mark(chars, ranges, c, c, !negated_char_class);
 
             // Save previous character.
             prevc = c;
@@ -183,7 +264,9 @@ bool lex::regular_expression::parse(const char* regex)
           case ']':
             {
               node* n;
-              if (((n = create_char_class_subtree(chars, 128)) == nullptr) ||
+              if (((n = create_char_class(chars,
+                                          ranges,
+                                          negated_char_class)) == nullptr) ||
                   (!add(nodes, n, regex))) {
                 return false;
               }
@@ -202,7 +285,9 @@ bool lex::regular_expression::parse(const char* regex)
               chars['-'] = !negated_char_class;
 
               node* n;
-              if (((n = create_char_class_subtree(chars, 128)) == nullptr) ||
+              if (((n = create_char_class(chars,
+                                          ranges,
+                                          negated_char_class)) == nullptr) ||
                   (!add(nodes, n, regex))) {
                 return false;
               }
@@ -212,9 +297,7 @@ bool lex::regular_expression::parse(const char* regex)
 
             break;
           case '\\':
-            if ((c = escape_character(regex[1])) != 0) {
-              regex++;
-            } else {
+            if (!escape(regex, c)) {
               // Invalid escape character.
               return false;
             }
@@ -223,9 +306,7 @@ bool lex::regular_expression::parse(const char* regex)
           default:
             if (c >= prevc) {
               if (prevc != 0) {
-                for (size_t i = prevc; i <= c; i++) {
-                  chars[i] = !negated_char_class;
-                }
+                mark(chars, ranges, prevc, c, !negated_char_class);
 
                 // Reset previous character.
                 prevc = 0;
@@ -245,16 +326,14 @@ bool lex::regular_expression::parse(const char* regex)
       case 4: // Negated character class.
         switch (c) {
           case '\\':
-            if ((c = escape_character(regex[1])) != 0) {
-              regex++;
-            } else {
+            if (!escape(regex, c)) {
               // Invalid escape character.
               return false;
             }
 
             // Fall through.
           default:
-            chars[c] = false;
+            mark(chars, ranges, c, c, false);
 
             // Save previous character.
             prevc = c;
@@ -274,11 +353,12 @@ bool lex::regular_expression::parse(const char* regex)
   if ((state == 0) &&
       (nodes.size() == 1) &&
       (nodes.top()) &&
-      ((nodes.top()->t != node::type::alternation) || (nodes.top()->right))) {
+      ((nodes.top()->t != node::type::alternation) || (nodes.top()->right)) &&
+      (simplify(nodes.top()))) {
     node* endmark;
-    if ((endmark = new (std::nothrow) node()) != nullptr) {
+    if ((endmark = _M_arena.create<node>(&_M_arena)) != nullptr) {
       node* concatenation;
-      if ((concatenation = new (std::nothrow) node()) != nullptr) {
+      if ((concatenation = _M_arena.create<node>(&_M_arena)) != nullptr) {
         endmark->t = node::type::endmark;
         endmark->pos = _M_npositions++;
 
@@ -291,10 +371,37 @@ bool lex::regular_expression::parse(const char* regex)
 
         nodes.pop();
 
+        // Sort the nodes in post-order and renumber the positions (the
+        // simplification has removed leaves).
+        if ((!sort_nodes()) || (!renumber_positions())) {
+          return false;
+        }
+
+        if (st) {
+          double end = stats::now();
+          st->parse_time = end - start;
+          st->sample_heap();
+
+          start = end;
+        }
+
         // Compute nullable, firstpos and lastpos.
-        return _M_root->init();
-      } else {
-        delete endmark;
+        for (size_t i = 0; i < _M_nnodes; i++) {
+          if (!_M_nodes[i]->init()) {
+            return false;
+          }
+        }
+
+        if (st) {
+          st->init_time = stats::now() - start;
+          st->sample_heap();
+
+          st->positions = _M_npositions;
+          st->nodes = _M_nnodes;
+          st->symbols = _M_nsymbols;
+        }
+
+        return true;
       }
     }
   }
@@ -302,103 +409,1450 @@ bool lex::regular_expression::parse(const char* regex)
   return false;
 }
 
-lex::node* lex::regular_expression::create_char_class_subtree(const bool* chars,
-                                                              size_t size)
+bool lex::regular_expression::sort_nodes()
 {
-  node* root = nullptr;
+  // Count the nodes.
+  nodes stack;
+  if (!stack.push(_M_root)) {
+    return false;
+  }
 
-  for (size_t i = 0; i < size; i++) {
-    if (chars[i]) {
-      node* n;
-      if ((add(i, _M_npositions)) &&
-          ((n = new (std::nothrow) node()) != nullptr)) {
-        n->t = node::type::symbol;
+  _M_nnodes = 0;
+
+  while (!stack.empty()) {
+    node* n = stack.top();
+    stack.pop();
 
-        n->s = i;
-        n->pos = _M_npositions++;
+    _M_nnodes++;
 
-        if (root) {
-          node* alternation;
-          if ((alternation = new (std::nothrow) node()) != nullptr) {
-            alternation->t = node::type::alternation;
+    if (((n->left) && (!stack.push(n->left))) ||
+        ((n->right) && (!stack.push(n->right)))) {
+      return false;
+    }
+  }
 
-            alternation->left = root;
-            alternation->right = n;
+  if ((_M_nodes = static_cast<node**>(
+                    _M_arena.allocate(_M_nnodes * sizeof(node*),
+                                      alignof(node*))
+                  )) == nullptr) {
+    return false;
+  }
 
-            root = alternation;
-          } else {
-            delete n;
-            delete root;
+  // Visiting the nodes in (node, left, right) order and filling the array
+  // from the end produces the post-order (left, right, node).
+  stack.push(_M_root);
 
-            return nullptr;
-          }
-        } else {
-          root = n;
+  size_t idx = _M_nnodes;
+
+  while (!stack.empty()) {
+    node* n = stack.top();
+    stack.pop();
+
+    _M_nodes[--idx] = n;
+
+    if (n->left) {
+      stack.push(n->left);
+    }
+
+    if (n->right) {
+      stack.push(n->right);
+    }
+  }
+
+  return true;
+}
+
+bool lex::regular_expression::renumber_positions()
+{
+  for (size_t i = 0; i < _M_nsymbols; i++) {
+    _M_symbols[i].p.clear();
+  }
+
+  _M_nsymbols = 0;
+  _M_npositions = 0;
+
+  // The endmark is the last leaf in post-order, so it gets the last
+  // position.
+  for (size_t i = 0; i < _M_nnodes; i++) {
+    node* n = _M_nodes[i];
+
+    switch (n->t) {
+      case node::type::symbol:
+        if (!add(n->s, _M_npositions)) {
+          return false;
         }
-      } else {
-        if (root) {
-          delete root;
+
+        break;
+      case node::type::char_class:
+        for (size_t c = 0; c < 256; c++) {
+          if (((n->chars[c >> 6] >> (c & 63)) & 1) &&
+              (!add(c, _M_npositions))) {
+            return false;
+          }
         }
 
-        return nullptr;
-      }
+        break;
+      case node::type::assertion:
+      case node::type::endmark:
+        break;
+      default:
+        continue;
     }
+
+    n->pos = _M_npositions++;
   }
 
-  return root;
+  return true;
 }
 
-bool lex::regular_expression::add(symbol s, position p)
+bool lex::regular_expression::simplify(node* root)
 {
-  for (size_t i = 0; i < _M_nsymbols; i++) {
-    if (_M_symbols[i].s == s) {
-      return _M_symbols[i].p.add(p);
+  // Sort the nodes of the subtree in post-order, so the children are
+  // simplified before their parents.
+  _M_root = root;
+  if (!sort_nodes()) {
+    return false;
+  }
+
+  // Only the outermost alternation of a sequence of alternations is
+  // simplified (it is flattened).
+  std::unordered_set<const node*> nested;
+  for (size_t i = 0; i < _M_nnodes; i++) {
+    const node* n = _M_nodes[i];
+
+    if (n->t == node::type::alternation) {
+      if (n->left->t == node::type::alternation) {
+        nested.insert(n->left);
+      }
+
+      if ((n->right) && (n->right->t == node::type::alternation)) {
+        nested.insert(n->right);
+      }
     }
   }
 
-  if (_M_nsymbols < max_symbols) {
-    _M_symbols[_M_nsymbols].s = s;
+  std::vector<node*> pending;
+
+  for (size_t i = 0; i < _M_nnodes; i++) {
+    node* n = _M_nodes[i];
+
+    switch (n->t) {
+      case node::type::repetition_zero_or_more:
+      case node::type::repetition_one_or_more:
+      case node::type::optional:
+        // (x*)* = (x+)* = (x?)* = (x*)+ = (x?)+ = (x*)? = (x+)? = x*,
+        // (x+)+ = x+ and (x?)? = x?.
+        switch (n->left->t) {
+          case node::type::repetition_zero_or_more:
+          case node::type::repetition_one_or_more:
+          case node::type::optional:
+            if (n->t != n->left->t) {
+              n->t = node::type::repetition_zero_or_more;
+            }
 
-    if (_M_symbols[_M_nsymbols].p.add(p)) {
-      _M_nsymbols++;
+            n->left = n->left->left;
+            break;
+          default:
+            break;
+        }
 
-      return true;
+        break;
+      case node::type::alternation:
+        if (nested.find(n) != nested.end()) {
+          break;
+        }
+
+        // Factoring common prefixes and suffixes creates new alternations,
+        // which are simplified as well.
+        pending.push_back(n);
+
+        do {
+          node* alternation = pending.back();
+          pending.pop_back();
+
+          if (!simplify_alternation(alternation, pending)) {
+            return false;
+          }
+        } while (!pending.empty());
+
+        break;
+      default:
+        break;
     }
   }
 
-  return false;
+  return true;
 }
 
-bool lex::regular_expression::add(nodes& nodes, node* n, const char*& regex)
+bool lex::regular_expression::simplify_alternation(node* n,
+                                                   std::vector<node*>& pending)
 {
-  switch (regex[1]) {
-    case '*':
-    case '+':
-    case '?':
-      {
-        node* repetition;
-        if ((repetition = new (std::nothrow) node()) != nullptr) {
-          switch (regex[1]) {
-            case '*':
-              repetition->t = node::type::repetition_zero_or_more;
-              break;
-            case '+':
-              repetition->t = node::type::repetition_one_or_more;
-              break;
-            case '?':
-              repetition->t = node::type::optional;
-              break;
-          }
+  std::vector<node*> branches;
+  flatten(n, node::type::alternation, branches);
 
-          repetition->left = n;
+  // Remove duplicated branches and merge the branches which match a single
+  // byte into a character class.
+  uint64_t bytes[4] = {0, 0, 0, 0};
+  size_t nbytes = 0;
 
-          n = repetition;
+  std::vector<node*> unique;
+  std::unordered_multimap<size_t, const node*> seen;
 
-          regex++;
-        } else {
-          delete n;
+  for (node* branch : branches) {
+    size_t h = hash(branch);
+
+    bool duplicated = false;
+    auto range = seen.equal_range(h);
+    for (auto it = range.first; it != range.second; ++it) {
+      if (equal(branch, it->second)) {
+        duplicated = true;
+        break;
+      }
+    }
+
+    if (duplicated) {
+      continue;
+    }
+
+    seen.emplace(h, branch);
+
+    switch (branch->t) {
+      case node::type::symbol:
+        bytes[branch->s >> 6] |= static_cast<uint64_t>(1) << (branch->s & 63);
+        nbytes++;
+
+        break;
+      case node::type::char_class:
+        for (size_t i = 0; i < 4; i++) {
+          bytes[i] |= branch->chars[i];
+        }
+
+        nbytes++;
+
+        break;
+      default:
+        unique.push_back(branch);
+    }
+  }
+
+  if (nbytes > 0) {
+    node* leaf;
+    if ((leaf = create_byte_class(bytes)) == nullptr) {
+      return false;
+    }
+
+    unique.push_back(leaf);
+  }
+
+  // Factor the common prefixes, then the common suffixes:
+  // xy | xz = x(y|z), xy | x = xy?, yx | zx = (y|z)x.
+  if ((!factor(unique, true, pending)) || (!factor(unique, false, pending))) {
+    return false;
+  }
+
+  node* root;
+  if ((root = join(node::type::alternation, unique)) == nullptr) {
+    return false;
+  }
+
+  replace(n, root);
+
+  return true;
+}
+
+bool lex::regular_expression::factor(std::vector<node*>& branches,
+                                     bool prefix,
+                                     std::vector<node*>& pending)
+{
+  if (branches.size() < 2) {
+    return true;
+  }
+
+  // Factors (operands of the concatenations) of the branches.
+  std::vector<std::vector<node*>> factors(branches.size());
+  for (size_t i = 0; i < branches.size(); i++) {
+    flatten(branches[i], node::type::concatenation, factors[i]);
+
+    if (!prefix) {
+      std::reverse(factors[i].begin(), factors[i].end());
+    }
+  }
+
+  // Group the branches which start (or end) with the same factor (in order
+  // of first appearance).
+  std::vector<std::vector<size_t>> groups;
+  std::unordered_multimap<size_t, size_t> heads;
+
+  for (size_t i = 0; i < branches.size(); i++) {
+    size_t h = hash(factors[i][0]);
+
+    bool found = false;
+    auto range = heads.equal_range(h);
+    for (auto it = range.first; it != range.second; ++it) {
+      std::vector<size_t>& group = groups[it->second];
+      if (equal(factors[group[0]][0], factors[i][0])) {
+        group.push_back(i);
+        found = true;
+        break;
+      }
+    }
+
+    if (!found) {
+      heads.emplace(h, groups.size());
+      groups.push_back(std::vector<size_t>(1, i));
+    }
+  }
+
+  std::vector<node*> result;
+
+  for (const std::vector<size_t>& group : groups) {
+    size_t i = group[0];
+
+    if (group.size() == 1) {
+      result.push_back(branches[i]);
+      continue;
+    }
+
+    // Length of the common part.
+    size_t len = 1;
+    while (true) {
+      bool common = true;
+      for (size_t g : group) {
+        if ((factors[g].size() <= len) ||
+            (!equal(factors[g][len], factors[i][len]))) {
+          common = false;
+          break;
+        }
+      }
+
+      if (!common) {
+        break;
+      }
+
+      len++;
+    }
+
+    // Alternation of the rest of the branches of the group.
+    std::vector<node*> rest;
+    bool empty = false;
+
+    for (size_t g : group) {
+      if (factors[g].size() > len) {
+        std::vector<node*> v(factors[g].begin() + len, factors[g].end());
+
+        if (!prefix) {
+          std::reverse(v.begin(), v.end());
+        }
+
+        node* r;
+        if ((r = join(node::type::concatenation, v)) == nullptr) {
+          return false;
+        }
+
+        rest.push_back(r);
+      } else {
+        empty = true;
+      }
+    }
+
+    std::vector<node*> common(factors[i].begin(), factors[i].begin() + len);
+
+    if (!rest.empty()) {
+      node* alternation;
+      if ((alternation = join(node::type::alternation, rest)) == nullptr) {
+        return false;
+      }
+
+      if (rest.size() > 1) {
+        pending.push_back(alternation);
+      }
+
+      if (empty) {
+        node* optional;
+        if ((optional = _M_arena.create<node>(&_M_arena)) == nullptr) {
           return false;
         }
+
+        optional->t = node::type::optional;
+        optional->left = alternation;
+
+        alternation = optional;
+      }
+
+      common.push_back(alternation);
+    }
+
+    if (!prefix) {
+      std::reverse(common.begin(), common.end());
+    }
+
+    node* r;
+    if ((r = join(node::type::concatenation, common)) == nullptr) {
+      return false;
+    }
+
+    result.push_back(r);
+  }
+
+  branches.swap(result);
+
+  return true;
+}
+
+void lex::regular_expression::flatten(node* n,
+                                      node::type t,
+                                      std::vector<node*>& v)
+{
+  // Operands from left to right.
+  std::vector<node*> stack(1, n);
+
+  while (!stack.empty()) {
+    node* top = stack.back();
+    stack.pop_back();
+
+    if (top->t == t) {
+      stack.push_back(top->right);
+      stack.push_back(top->left);
+    } else {
+      v.push_back(top);
+    }
+  }
+}
+
+lex::node* lex::regular_expression::join(node::type t,
+                                         const std::vector<node*>& v)
+{
+  node* root = v[0];
+
+  for (size_t i = 1; i < v.size(); i++) {
+    node* n;
+    if ((n = _M_arena.create<node>(&_M_arena)) == nullptr) {
+      return nullptr;
+    }
+
+    n->t = t;
+
+    n->left = root;
+    n->right = v[i];
+
+    root = n;
+  }
+
+  return root;
+}
+
+void lex::regular_expression::replace(node* n, const node* by)
+{
+  if (n != by) {
+    n->t = by->t;
+    n->s = by->s;
+    n->pos = by->pos;
+    n->left = by->left;
+    n->right = by->right;
+    n->chars = by->chars;
+  }
+}
+
+size_t lex::regular_expression::hash(const node* n)
+{
+  size_t h = 0;
+
+  std::vector<const node*> stack(1, n);
+
+  while (!stack.empty()) {
+    const node* top = stack.back();
+    stack.pop_back();
+
+    size_t v = static_cast<size_t>(top->t);
+
+    switch (top->t) {
+      case node::type::symbol:
+      case node::type::assertion:
+        v = (v << 8) | top->s;
+        break;
+      case node::type::char_class:
+        for (size_t i = 0; i < 4; i++) {
+          v = (v * 31) + top->chars[i];
+        }
+
+        break;
+      case node::type::endmark:
+        break;
+      case node::type::group:
+        // Groups with different numbers are not interchangeable.
+        v = (v * 31) + top->pos;
+
+        // Fall through.
+      default:
+        stack.push_back(top->left);
+
+        if (top->right) {
+          stack.push_back(top->right);
+        }
+    }
+
+    h = (h * 1000003) ^ v;
+  }
+
+  return h;
+}
+
+bool lex::regular_expression::equal(const node* a, const node* b)
+{
+  std::vector<std::pair<const node*, const node*>> stack;
+  stack.push_back(std::make_pair(a, b));
+
+  while (!stack.empty()) {
+    std::pair<const node*, const node*> p = stack.back();
+    stack.pop_back();
+
+    if (p.first->t != p.second->t) {
+      return false;
+    }
+
+    switch (p.first->t) {
+      case node::type::symbol:
+      case node::type::assertion:
+        if (p.first->s != p.second->s) {
+          return false;
+        }
+
+        break;
+      case node::type::char_class:
+        if (memcmp(p.first->chars, p.second->chars, 4 * sizeof(uint64_t)) !=
+            0) {
+          return false;
+        }
+
+        break;
+      case node::type::endmark:
+        break;
+      case node::type::group:
+        if (p.first->pos != p.second->pos) {
+          return false;
+        }
+
+        // Fall through.
+      default:
+        stack.push_back(std::make_pair(p.first->left, p.second->left));
+
+        if (p.first->right) {
+          stack.push_back(std::make_pair(p.first->right, p.second->right));
+        }
+    }
+  }
+
+  return true;
+}
+
+bool lex::regular_expression::has_bounds(const char* regex)
+{
+  // Skip '{'.
+  regex++;
+
+  if ((*regex < '0') || (*regex > '9')) {
+    return false;
+  }
+
+  while ((*++regex >= '0') && (*regex <= '9'));
+
+  if (*regex == ',') {
+    while ((*++regex >= '0') && (*regex <= '9'));
+  }
+
+  return (*regex == '}');
+}
+
+bool lex::regular_expression::parse_bounds(const char* regex,
+                                           size_t& min,
+                                           size_t& max,
+                                           const char*& end)
+{
+  // Skip '{'.
+  regex++;
+
+  if ((*regex < '0') || (*regex > '9')) {
+    return false;
+  }
+
+  min = 0;
+  do {
+    if ((min = (min * 10) + (*regex - '0')) > max_repetitions) {
+      return false;
+    }
+  } while ((*++regex >= '0') && (*regex <= '9'));
+
+  switch (*regex) {
+    case '}':
+      // {m}
+      max = min;
+      break;
+    case ',':
+      if (*++regex == '}') {
+        // {m,}
+        max = unbounded;
+      } else if ((*regex >= '0') && (*regex <= '9')) {
+        // {m,n}
+        max = 0;
+        do {
+          if ((max = (max * 10) + (*regex - '0')) > max_repetitions) {
+            return false;
+          }
+        } while ((*++regex >= '0') && (*regex <= '9'));
+
+        if ((*regex != '}') || (max < min)) {
+          return false;
+        }
+      } else {
+        return false;
+      }
+
+      break;
+    default:
+      return false;
+  }
+
+  // {0} and {0,0} would match only the empty string.
+  if (max == 0) {
+    return false;
+  }
+
+  // Point to '}'.
+  end = regex;
+
+  return true;
+}
+
+lex::node* lex::regular_expression::expand_repetition(node* n,
+                                                      size_t min,
+                                                      size_t max)
+{
+  // Number of copies of the subtree.
+  size_t copies = (max != unbounded) ? max : MAX(min, 1);
+
+  // Check the expansion limit before copying anything.
+  size_t npositions = count_positions(n);
+  if ((npositions > 0) &&
+      (copies - 1 > (_M_expansion_limit - _M_expanded) / npositions)) {
+    return nullptr;
+  }
+
+  _M_expanded += (copies - 1) * npositions;
+
+  // x{m,n} = x ... x (x (x ... (x)? ...)?)?, with m copies of x before the
+  // optional part. Nesting the optional copies (instead of x?x?...x?) keeps
+  // the size of the followpos sets linear in the number of copies.
+  // x{m,} = x ... x x+ (or x* if m = 0).
+  // The original subtree is used as one of the copies.
+  node* root = nullptr;
+  node* original = n;
+
+  if (max == unbounded) {
+    node* repetition;
+    if ((repetition = _M_arena.create<node>(&_M_arena)) == nullptr) {
+      return nullptr;
+    }
+
+    repetition->t = (min > 0) ? node::type::repetition_one_or_more :
+                                node::type::repetition_zero_or_more;
+
+    repetition->left = original;
+    root = repetition;
+
+    original = nullptr;
+
+    if (min > 0) {
+      min--;
+    }
+  } else {
+    // Build the optional part from the inside out.
+    for (size_t i = max - min; i > 0; i--) {
+      node* copy;
+      if ((copy = original ? original : clone(n)) == nullptr) {
+        return nullptr;
+      }
+
+      original = nullptr;
+
+      if (root) {
+        node* concatenation;
+        if ((concatenation = _M_arena.create<node>(&_M_arena)) == nullptr) {
+          return nullptr;
+        }
+
+        concatenation->t = node::type::concatenation;
+        concatenation->left = copy;
+        concatenation->right = root;
+
+        copy = concatenation;
+      }
+
+      node* optional;
+      if ((optional = _M_arena.create<node>(&_M_arena)) == nullptr) {
+        return nullptr;
+      }
+
+      optional->t = node::type::optional;
+      optional->left = copy;
+
+      root = optional;
+    }
+  }
+
+  // Mandatory part.
+  for (size_t i = min; i > 0; i--) {
+    node* copy;
+    if ((copy = original ? original : clone(n)) == nullptr) {
+      return nullptr;
+    }
+
+    original = nullptr;
+
+    if (root) {
+      node* concatenation;
+      if ((concatenation = _M_arena.create<node>(&_M_arena)) == nullptr) {
+        return nullptr;
+      }
+
+      concatenation->t = node::type::concatenation;
+      concatenation->left = copy;
+      concatenation->right = root;
+
+      copy = concatenation;
+    }
+
+    root = copy;
+  }
+
+  return root;
+}
+
+size_t lex::regular_expression::count_positions(const node* n)
+{
+  nodes stack;
+  if (!stack.push(const_cast<node*>(n))) {
+    return 0;
+  }
+
+  size_t count = 0;
+
+  while (!stack.empty()) {
+    const node* top = stack.top();
+    stack.pop();
+
+    if (top->leaf()) {
+      count++;
+    } else if (((top->left) && (!stack.push(top->left))) ||
+               ((top->right) && (!stack.push(top->right)))) {
+      return 0;
+    }
+  }
+
+  return count;
+}
+
+lex::node* lex::regular_expression::clone(const node* n)
+{
+  // Each copy gets new positions.
+  struct pending {
+    const node* src;
+    node** dst;
+  };
+
+  std::vector<pending> stack;
+
+  node* root = nullptr;
+  stack.push_back({n, &root});
+
+  while (!stack.empty()) {
+    pending p = stack.back();
+    stack.pop_back();
+
+    node* copy;
+    if ((copy = _M_arena.create<node>(&_M_arena)) == nullptr) {
+      return nullptr;
+    }
+
+    copy->t = p.src->t;
+
+    if (p.src->t == node::type::char_class) {
+      // The copy shares the bitmap of the original.
+      for (size_t i = 0; i < 256; i++) {
+        if (((p.src->chars[i >> 6] >> (i & 63)) & 1) &&
+            (!add(i, _M_npositions))) {
+          return nullptr;
+        }
+      }
+
+      copy->chars = p.src->chars;
+      copy->pos = _M_npositions++;
+    } else if (p.src->t == node::type::assertion) {
+      copy->s = p.src->s;
+      copy->pos = _M_npositions++;
+    } else if (p.src->leaf()) {
+      if (!add(p.src->s, _M_npositions)) {
+        return nullptr;
+      }
+
+      copy->s = p.src->s;
+      copy->pos = _M_npositions++;
+    } else {
+      // The copies of a group keep its number.
+      copy->pos = p.src->pos;
+
+      if (p.src->left) {
+        stack.push_back({p.src->left, &copy->left});
+      }
+
+      if (p.src->right) {
+        stack.push_back({p.src->right, &copy->right});
+      }
+    }
+
+    *p.dst = copy;
+  }
+
+  return root;
+}
+
+bool lex::regular_expression::decode_utf8(const char*& regex, uint32_t& c)
+{
+  const uint8_t* s = reinterpret_cast<const uint8_t*>(regex);
+
+  size_t len;
+  uint32_t min;
+
+  if ((s[0] >= 0xc2) && (s[0] <= 0xdf)) {
+    c = s[0] & 0x1f;
+    len = 2;
+    min = 0x80;
+  } else if ((s[0] >= 0xe0) && (s[0] <= 0xef)) {
+    c = s[0] & 0x0f;
+    len = 3;
+    min = 0x800;
+  } else if ((s[0] >= 0xf0) && (s[0] <= 0xf4)) {
+    c = s[0] & 0x07;
+    len = 4;
+    min = 0x10000;
+  } else {
+    return false;
+  }
+
+  for (size_t i = 1; i < len; i++) {
+    if ((s[i] & 0xc0) != 0x80) {
+      return false;
+    }
+
+    c = (c << 6) | (s[i] & 0x3f);
+  }
+
+  // Reject overlong encodings, surrogates and code points > U+10FFFF.
+  if ((c < min) || ((c >= 0xd800) && (c <= 0xdfff)) || (c > max_code_point)) {
+    return false;
+  }
+
+  regex += len - 1;
+
+  return true;
+}
+
+size_t lex::regular_expression::encode_utf8(uint32_t c, uint8_t* buf)
+{
+  if (c < 0x80) {
+    buf[0] = c;
+    return 1;
+  } else if (c < 0x800) {
+    buf[0] = 0xc0 | (c >> 6);
+    buf[1] = 0x80 | (c & 0x3f);
+    return 2;
+  } else if (c < 0x10000) {
+    buf[0] = 0xe0 | (c >> 12);
+    buf[1] = 0x80 | ((c >> 6) & 0x3f);
+    buf[2] = 0x80 | (c & 0x3f);
+    return 3;
+  } else {
+    buf[0] = 0xf0 | (c >> 18);
+    buf[1] = 0x80 | ((c >> 12) & 0x3f);
+    buf[2] = 0x80 | ((c >> 6) & 0x3f);
+    buf[3] = 0x80 | (c & 0x3f);
+    return 4;
+  }
+}
+
+bool lex::regular_expression::escape(const char*& regex, uint32_t& c) const
+{
+  if (_M_flags & utf8) {
+    // \u{hex}
+    if ((regex[1] == 'u') && (regex[2] == '{')) {
+      const char* ptr = regex + 3;
+
+      c = 0;
+
+      size_t ndigits = 0;
+      for (; *ptr != '}'; ptr++) {
+        uint8_t digit;
+        if ((*ptr >= '0') && (*ptr <= '9')) {
+          digit = *ptr - '0';
+        } else if ((*ptr >= 'a') && (*ptr <= 'f')) {
+          digit = *ptr - 'a' + 10;
+        } else if ((*ptr >= 'A') && (*ptr <= 'F')) {
+          digit = *ptr - 'A' + 10;
+        } else {
+          return false;
+        }
+
+        if (++ndigits > 6) {
+          return false;
+        }
+
+        c = (c << 4) | digit;
+      }
+
+      if ((c == 0) ||
+          (c > max_code_point) ||
+          ((c >= 0xd800) && (c <= 0xdfff))) {
+        return false;
+      }
+
+      regex = ptr;
+
+      return true;
+    }
+
+    // Escaped non-ASCII character.
+    if (static_cast<uint8_t>(regex[1]) >= 0x80) {
+      regex++;
+      return decode_utf8(regex, c);
+    }
+  }
+
+  if ((c = escape_character(regex[1])) != 0) {
+    regex++;
+    return true;
+  }
+
+  return false;
+}
+
+void lex::regular_expression::mark(bool* chars,
+                                   code_point_ranges& ranges,
+                                   uint32_t first,
+                                   uint32_t last,
+                                   bool value) const
+{
+  uint32_t limit = (_M_flags & utf8) ? 0x80 : 0x100;
+
+  for (uint32_t c = first; (c <= last) && (c < limit); c++) {
+    chars[c] = value;
+  }
+
+  if (last >= limit) {
+    ranges.push_back({MAX(first, limit), last});
+  }
+
+  if (_M_flags & icase) {
+    // Only the ASCII characters are folded when not in UTF-8 mode.
+    uint32_t end = (_M_flags & utf8) ? last : MIN(last, 0x7f);
+
+    for (uint32_t c = case_folding::next_foldable(first);
+         c <= end;
+         c = case_folding::next_foldable(c + 1)) {
+      // The orbit is bounded, in case the table is broken.
+      uint32_t other = case_folding::next(c);
+
+      for (size_t n = 1;
+           (other != c) && (n < case_folding::max_orbit);
+           n++, other = case_folding::next(other)) {
+        if (other < 0x80) {
+          chars[other] = value;
+        } else if (_M_flags & utf8) {
+          ranges.push_back({other, other});
+        }
+      }
+    }
+  }
+}
+
+lex::node* lex::regular_expression::create_symbol(uint8_t c)
+{
+  node* n;
+  if ((add(c, _M_npositions)) &&
+      ((n = _M_arena.create<node>(&_M_arena)) != nullptr)) {
+    n->t = node::type::symbol;
+
+    n->s = c;
+    n->pos = _M_npositions++;
+
+    return n;
+  }
+
+  return nullptr;
+}
+
+lex::node* lex::regular_expression::create_assertion(uint8_t kind)
+{
+  node* n;
+  if ((n = _M_arena.create<node>(&_M_arena)) != nullptr) {
+    n->t = node::type::assertion;
+
+    n->s = kind;
+    n->pos = _M_npositions++;
+  }
+
+  return n;
+}
+
+lex::node* lex::regular_expression::create_byte_class(const uint64_t* bytes)
+{
+  size_t count = 0;
+  size_t last = 0;
+
+  for (size_t i = 0; i < 256; i++) {
+    if ((bytes[i >> 6] >> (i & 63)) & 1) {
+      count++;
+      last = i;
+    }
+  }
+
+  switch (count) {
+    case 0:
+      return nullptr;
+    case 1:
+      return create_symbol(last);
+  }
+
+  // A single position for all the bytes of the class.
+  uint64_t* chars;
+  if ((chars = _M_arena.create_array<uint64_t>(4)) == nullptr) {
+    return nullptr;
+  }
+
+  memcpy(chars, bytes, 4 * sizeof(uint64_t));
+
+  for (size_t i = 0; i < 256; i++) {
+    if (((chars[i >> 6] >> (i & 63)) & 1) && (!add(i, _M_npositions))) {
+      return nullptr;
+    }
+  }
+
+  node* n;
+  if ((n = _M_arena.create<node>(&_M_arena)) != nullptr) {
+    n->t = node::type::char_class;
+
+    n->chars = chars;
+    n->pos = _M_npositions++;
+  }
+
+  return n;
+}
+
+lex::node* lex::regular_expression::create_character(uint32_t c)
+{
+  // A character with other cases is a character class.
+  if ((_M_flags & icase) &&
+      ((c < 0x80) || (_M_flags & utf8)) &&
+      (case_folding::next(c) != c)) {
+    bool chars[256];
+    for (size_t i = 0; i < ARRAY_SIZE(chars); i++) {
+      chars[i] = false;
+    }
+
+    code_point_ranges ranges;
+    mark(chars, ranges, c, c, true);
+
+    return create_char_class(chars, ranges, false);
+  }
+
+  if ((c < 0x80) || (!(_M_flags & utf8))) {
+    return create_symbol(c);
+  }
+
+  // Concatenation of the bytes of the UTF-8 encoding.
+  uint8_t buf[4];
+  size_t len = encode_utf8(c, buf);
+
+  node* root = nullptr;
+
+  for (size_t i = 0; i < len; i++) {
+    node* n;
+    if ((n = create_symbol(buf[i])) == nullptr) {
+      return nullptr;
+    }
+
+    if (root) {
+      node* concatenation;
+      if ((concatenation = _M_arena.create<node>(&_M_arena)) == nullptr) {
+        return nullptr;
+      }
+
+      concatenation->t = node::type::concatenation;
+
+      concatenation->left = root;
+      concatenation->right = n;
+
+      root = concatenation;
+    } else {
+      root = n;
+    }
+  }
+
+  return root;
+}
+
+lex::node* lex::regular_expression::create_char_class(const bool* chars,
+                                                      code_point_ranges& ranges,
+                                                      bool negated)
+{
+  // Only the ASCII characters are taken from 'chars' (like the negated
+  // classes and '.' have always done when not in UTF-8 mode).
+  uint64_t bytes[4] = {0, 0, 0, 0};
+  for (size_t i = 0; i < 128; i++) {
+    if (chars[i]) {
+      bytes[i >> 6] |= static_cast<uint64_t>(1) << (i & 63);
+    }
+  }
+
+  node* ascii = nullptr;
+  if (((bytes[0]) || (bytes[1])) &&
+      ((ascii = create_byte_class(bytes)) == nullptr)) {
+    return nullptr;
+  }
+
+  if (!(_M_flags & utf8)) {
+    return ascii;
+  }
+
+  // Sort and merge the ranges of code points >= 0x80.
+  std::sort(ranges.begin(),
+            ranges.end(),
+            [](const code_point_range& a, const code_point_range& b) {
+              return a.first < b.first;
+            });
+
+  code_point_ranges merged;
+  for (const code_point_range& r : ranges) {
+    if ((!merged.empty()) && (r.first <= merged.back().last + 1)) {
+      merged.back().last = MAX(merged.back().last, r.last);
+    } else {
+      merged.push_back(r);
+    }
+  }
+
+  // Complement the ranges of a negated class (or of '.').
+  if (negated) {
+    code_point_ranges complement;
+
+    uint32_t next = 0x80;
+    for (const code_point_range& r : merged) {
+      if (r.first > next) {
+        complement.push_back({next, r.first - 1});
+      }
+
+      next = r.last + 1;
+    }
+
+    if (next <= max_code_point) {
+      complement.push_back({next, max_code_point});
+    }
+
+    merged.swap(complement);
+  }
+
+  // Remove the surrogates (they cannot be encoded in UTF-8).
+  code_point_ranges valid;
+  for (const code_point_range& r : merged) {
+    if ((r.first < 0xd800) && (r.last >= 0xd800)) {
+      valid.push_back({r.first, 0xd7ff});
+    } else if (r.first < 0xd800) {
+      valid.push_back(r);
+    }
+
+    if ((r.last > 0xdfff) && (r.first <= 0xdfff)) {
+      valid.push_back({0xe000, r.last});
+    } else if (r.first > 0xdfff) {
+      valid.push_back(r);
+    }
+  }
+
+  if (valid.empty()) {
+    return ascii;
+  }
+
+  node* n;
+  if ((n = create_utf8_class(valid)) == nullptr) {
+    return nullptr;
+  }
+
+  if (ascii) {
+    node* alternation;
+    if ((alternation = _M_arena.create<node>(&_M_arena)) == nullptr) {
+      return nullptr;
+    }
+
+    alternation->t = node::type::alternation;
+
+    alternation->left = ascii;
+    alternation->right = n;
+
+    n = alternation;
+  }
+
+  return n;
+}
+
+lex::node*
+lex::regular_expression::create_utf8_class(const code_point_ranges& ranges)
+{
+  // Sequence of byte ranges: a range of code points whose UTF-8 encodings
+  // are the strings s[0] s[1] ... s[len - 1] with lo[i] <= s[i] <= hi[i].
+  struct sequence {
+    uint8_t lo[4];
+    uint8_t hi[4];
+    size_t len;
+  };
+
+  std::vector<sequence> sequences;
+
+  // Split the ranges of code points (like RE2 and Rust's regex-syntax do).
+  std::vector<code_point_range> stack(ranges.rbegin(), ranges.rend());
+
+  while (!stack.empty()) {
+    code_point_range r = stack.back();
+    stack.pop_back();
+
+    // The encodings of both ends must have the same length.
+    static const uint32_t boundaries[] = {0x7ff, 0xffff};
+
+    bool split = false;
+    for (size_t i = 0; (i < ARRAY_SIZE(boundaries)) && (!split); i++) {
+      if ((r.first <= boundaries[i]) && (r.last > boundaries[i])) {
+        stack.push_back({boundaries[i] + 1, r.last});
+        stack.push_back({r.first, boundaries[i]});
+
+        split = true;
+      }
+    }
+
+    // The continuation bytes must cover whole blocks.
+    for (size_t i = 1; (i < 4) && (!split); i++) {
+      uint32_t max = (static_cast<uint32_t>(1) << (6 * i)) - 1;
+
+      if ((r.first & ~max) != (r.last & ~max)) {
+        if ((r.first & max) != 0) {
+          stack.push_back({(r.first | max) + 1, r.last});
+          stack.push_back({r.first, r.first | max});
+
+          split = true;
+        } else if ((r.last & max) != max) {
+          stack.push_back({r.last & ~max, r.last});
+          stack.push_back({r.first, (r.last & ~max) - 1});
+
+          split = true;
+        }
+      }
+    }
+
+    if (!split) {
+      sequence seq;
+      seq.len = encode_utf8(r.first, seq.lo);
+      encode_utf8(r.last, seq.hi);
+
+      sequences.push_back(seq);
+    }
+  }
+
+  // Share the common suffixes: the byte ranges are inserted, from the last
+  // one to the first one, in a trie of suffixes, so the sequences which only
+  // differ in the first bytes get the same positions for the last bytes.
+  struct trie_node {
+    uint8_t lo;
+    uint8_t hi;
+    std::vector<size_t> children;
+  };
+
+  std::vector<trie_node> trie(1);
+
+  for (const sequence& seq : sequences) {
+    size_t current = 0;
+
+    for (size_t i = seq.len; i > 0; i--) {
+      size_t next = 0;
+      for (size_t child : trie[current].children) {
+        if ((trie[child].lo == seq.lo[i - 1]) &&
+            (trie[child].hi == seq.hi[i - 1])) {
+          next = child;
+          break;
+        }
+      }
+
+      if (next == 0) {
+        next = trie.size();
+        trie.push_back({seq.lo[i - 1], seq.hi[i - 1], {}});
+        trie[current].children.push_back(next);
+      }
+
+      current = next;
+    }
+  }
+
+  // Build the subtree of a trie node: the alternation, for each child, of
+  // the subtree of the child followed by the byte range of the child (the
+  // children without children are merged in a single class).
+  std::vector<node*> built(trie.size(), nullptr);
+
+  // Post-order: the trie nodes are created after their parents, so they are
+  // visited backwards.
+  for (size_t idx = trie.size(); idx > 0; idx--) {
+    const trie_node& t = trie[idx - 1];
+
+    if (t.children.empty()) {
+      continue;
+    }
+
+    uint64_t bytes[4] = {0, 0, 0, 0};
+    bool leaves = false;
+
+    node* root = nullptr;
+
+    for (size_t child : t.children) {
+      const trie_node& c = trie[child];
+
+      if (c.children.empty()) {
+        for (size_t b = c.lo; b <= c.hi; b++) {
+          bytes[b >> 6] |= static_cast<uint64_t>(1) << (b & 63);
+        }
+
+        leaves = true;
+        continue;
+      }
+
+      uint64_t range[4] = {0, 0, 0, 0};
+      for (size_t b = c.lo; b <= c.hi; b++) {
+        range[b >> 6] |= static_cast<uint64_t>(1) << (b & 63);
+      }
+
+      node* leaf;
+      node* concatenation;
+      if (((leaf = create_byte_class(range)) == nullptr) ||
+          ((concatenation = _M_arena.create<node>(&_M_arena)) == nullptr)) {
+        return nullptr;
+      }
+
+      concatenation->t = node::type::concatenation;
+
+      concatenation->left = built[child];
+      concatenation->right = leaf;
+
+      if (root) {
+        node* alternation;
+        if ((alternation = _M_arena.create<node>(&_M_arena)) == nullptr) {
+          return nullptr;
+        }
+
+        alternation->t = node::type::alternation;
+
+        alternation->left = root;
+        alternation->right = concatenation;
+
+        root = alternation;
+      } else {
+        root = concatenation;
+      }
+    }
+
+    if (leaves) {
+      node* leaf;
+      if ((leaf = create_byte_class(bytes)) == nullptr) {
+        return nullptr;
+      }
+
+      if (root) {
+        node* alternation;
+        if ((alternation = _M_arena.create<node>(&_M_arena)) == nullptr) {
+          return nullptr;
+        }
+
+        alternation->t = node::type::alternation;
+
+        alternation->left = leaf;
+        alternation->right = root;
+
+        root = alternation;
+      } else {
+        root = leaf;
+      }
+    }
+
+    built[idx - 1] = root;
+  }
+
+  return built[0];
+}
+
+bool lex::regular_expression::add(symbol s, position p)
+{
+  for (size_t i = 0; i < _M_nsymbols; i++) {
+    if (_M_symbols[i].s == s) {
+      return _M_symbols[i].p.add(p);
+    }
+  }
+
+  if (_M_nsymbols < max_symbols) {
+    _M_symbols[_M_nsymbols].s = s;
+
+    if (_M_symbols[_M_nsymbols].p.add(p)) {
+      _M_nsymbols++;
+
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool lex::regular_expression::add(nodes& nodes, node* n, const char*& regex)
+{
+  switch (regex[1]) {
+    case '*':
+    case '+':
+    case '?':
+      {
+        node* repetition;
+        if ((repetition = _M_arena.create<node>(&_M_arena)) != nullptr) {
+          switch (regex[1]) {
+            case '*':
+              repetition->t = node::type::repetition_zero_or_more;
+              break;
+            case '+':
+              repetition->t = node::type::repetition_one_or_more;
+              break;
+            case '?':
+              repetition->t = node::type::optional;
+              break;
+          }
+
+          repetition->left = n;
+
+          n = repetition;
+
+          regex++;
+        } else {
+          return false;
+        }
+      }
+
+      break;
+    case '{':
+      // Counted repetition: {m}, {m,} or {m,n}.
+      if (has_bounds(regex + 1)) {
+        size_t min, max;
+        const char* end;
+        if ((!parse_bounds(regex + 1, min, max, end)) ||
+            ((n = expand_repetition(n, min, max)) == nullptr)) {
+          return false;
+        }
+
+        regex = end;
       }
 
       break;
@@ -406,13 +1860,12 @@ bool lex::regular_expression::add(nodes& nodes, node* n, const char*& regex)
 
   if (!nodes.top()) {
     if (!nodes.push(n)) {
-      delete n;
       return false;
     }
   } else if ((nodes.top()->t != node::type::alternation) ||
              (nodes.top()->right)) {
     node* concatenation;
-    if ((concatenation = new (std::nothrow) node()) != nullptr) {
+    if ((concatenation = _M_arena.create<node>(&_M_arena)) != nullptr) {
       concatenation->t = node::type::concatenation;
 
       concatenation->left = nodes.top();
@@ -421,7 +1874,6 @@ bool lex::regular_expression::add(nodes& nodes, node* n, const char*& regex)
       nodes.pop();
       nodes.push(concatenation);
     } else {
-      delete n;
       return false;
     }
   } else {
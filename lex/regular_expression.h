@@ -1,7 +1,10 @@
 #ifndef LEX_REGULAR_EXPRESSION_H
 #define LEX_REGULAR_EXPRESSION_H
 
+#include <stdint.h>
+#include <vector>
 #include "lex/node.h"
+#include "lex/stats.h"
 
 namespace lex {
   class regular_expression {
@@ -12,12 +15,54 @@ namespace lex {
       // Destructor.
       ~regular_expression();
 
+      // Maximum number of positions which can be created by expanding
+      // counted repetitions ({m}, {m,} and {m,n}).
+      static const size_t default_expansion_limit = 1024 * 1024;
+
+      // Set expansion limit (must be called before parse()).
+      void set_expansion_limit(size_t limit);
+
+      // Flags.
+      // utf8: the regular expression and the input are UTF-8; '.' and the
+      // character classes match whole code points and \u{hex} escapes are
+      // recognized.
+      static const unsigned utf8 = 0x01;
+
+      // icase: case-insensitive matching (simple case folding of Unicode in
+      // UTF-8 mode, ASCII otherwise). The characters are folded in the
+      // leaves, so the syntax tree has no more positions than with the
+      // case-sensitive regular expression.
+      static const unsigned icase = 0x02;
+
+      // captures: the parentheses are capture groups (numbered from 1 in
+      // the order of their opening parentheses), which are kept in the
+      // syntax tree as group nodes (see tagged_dfa).
+      static const unsigned captures = 0x04;
+
+      // Set flags (must be called before parse()).
+      void set_flags(unsigned flags);
+
+      // Get flags.
+      unsigned flags() const;
+
+      // Clear the syntax tree, so the regular expression can be reused to
+      // parse another one (the flags and the expansion limit are kept).
+      void clear();
+
       // Parse.
-      bool parse(const char* regex);
+      // If 'st' is not null, the statistics of the parse are saved in it.
+      bool parse(const char* regex, stats* st = nullptr);
 
       // Get root of the syntax tree.
       const node* root() const;
 
+      // Get number of nodes of the syntax tree.
+      size_t number_nodes() const;
+
+      // Get node (the nodes are sorted in post-order: the children come
+      // before their parent).
+      const node* get_node(size_t idx) const;
+
       // Get number of positions.
       size_t number_positions() const;
 
@@ -30,12 +75,40 @@ namespace lex {
       // Get positions.
       const positions& get_positions(size_t idx) const;
 
+      // Get number of capture groups.
+      size_t number_groups() const;
+
+      // Has the regular expression assertions (^, $, \b or \B)?
+      bool has_assertions() const;
+
     private:
       static const size_t max_symbols = 256;
 
+      // Maximum value of a bound in a counted repetition.
+      static const size_t max_repetitions = 100000;
+      static const size_t unbounded = static_cast<size_t>(-1);
+
+      static const uint32_t max_code_point = 0x10ffff;
+
+      // Range of code points.
+      struct code_point_range {
+        uint32_t first;
+        uint32_t last;
+      };
+
+      typedef std::vector<code_point_range> code_point_ranges;
+
+      // Arena for the nodes of the syntax tree and their positions. It is
+      // released at once when the regular expression is destroyed.
+      arena _M_arena;
+
       // Root of the syntax tree.
       node* _M_root;
 
+      // Nodes of the syntax tree in post-order.
+      node** _M_nodes;
+      size_t _M_nnodes;
+
       size_t _M_npositions;
 
       struct symbol_positions_pair {
@@ -46,14 +119,126 @@ namespace lex {
       symbol_positions_pair _M_symbols[max_symbols];
       size_t _M_nsymbols;
 
+      // Expansion limit and number of positions created by the expansion of
+      // counted repetitions so far.
+      size_t _M_expansion_limit;
+      size_t _M_expanded;
+
+      // Number of capture groups.
+      size_t _M_ngroups;
+
+      unsigned _M_flags;
+
+      // Sort the nodes of the syntax tree in post-order.
+      bool sort_nodes();
+
+      // Renumber the positions of the leaves (in post-order) and rebuild the
+      // table of symbols.
+      bool renumber_positions();
+
+      // Simplify the syntax tree (in place): nested repetitions are
+      // collapsed, the alternations are flattened, their duplicated branches
+      // are removed, their single byte branches are merged in a character
+      // class and their common prefixes and suffixes are factored.
+      bool simplify(node* root);
+
+      // Simplify alternation (the branches must be simplified already). The
+      // alternations created by factoring are added to 'pending'.
+      bool simplify_alternation(node* n, std::vector<node*>& pending);
+
+      // Factor the common prefixes (or suffixes) of the branches of an
+      // alternation.
+      bool factor(std::vector<node*>& branches,
+                  bool prefix,
+                  std::vector<node*>& pending);
+
+      // Get the operands of a sequence of nodes of type 't' (alternations
+      // or concatenations) from left to right.
+      static void flatten(node* n, node::type t, std::vector<node*>& v);
+
+      // Join the nodes in 'v' (not empty) with nodes of type 't'.
+      node* join(node::type t, const std::vector<node*>& v);
+
+      // Replace node 'n' by node 'by'.
+      static void replace(node* n, const node* by);
+
+      // Compute hash of a subtree (equal subtrees have the same hash).
+      static size_t hash(const node* n);
+
+      // Are the subtrees equal?
+      static bool equal(const node* a, const node* b);
+
+      // Does 'regex' (which points to '{') have the syntax of the bounds of
+      // a counted repetition ({m}, {m,} or {m,n})? If not, the '{' is a
+      // literal.
+      static bool has_bounds(const char* regex);
+
+      // Parse the bounds of a counted repetition ('regex' points to '{').
+      // On success, 'end' points to '}'.
+      static bool parse_bounds(const char* regex,
+                               size_t& min,
+                               size_t& max,
+                               const char*& end);
+
+      // Expand counted repetition.
+      node* expand_repetition(node* n, size_t min, size_t max);
+
+      // Count positions of a subtree.
+      static size_t count_positions(const node* n);
+
+      // Copy a subtree (with new positions).
+      node* clone(const node* n);
+
+      // Decode UTF-8 character ('regex' points to the first byte). On
+      // success, 'regex' points to the last byte of the character.
+      static bool decode_utf8(const char*& regex, uint32_t& c);
+
+      // Encode code point as UTF-8 (returns the number of bytes).
+      static size_t encode_utf8(uint32_t c, uint8_t* buf);
+
+      // Parse escape sequence ('regex' points to '\\'). On success, 'regex'
+      // points to the last character of the escape sequence.
+      bool escape(const char*& regex, uint32_t& c) const;
+
+      // Add the range [first, last] to a character class ('value' is false
+      // for the characters which have to be removed from a negated class).
+      // The ASCII characters (all of them when not in UTF-8 mode) are
+      // marked in 'chars', the other code points are saved in 'ranges'.
+      // In case-insensitive mode, the other cases are also added.
+      void mark(bool* chars,
+                code_point_ranges& ranges,
+                uint32_t first,
+                uint32_t last,
+                bool value) const;
+
+      // Create symbol leaf.
+      node* create_symbol(uint8_t c);
+
+      // Create assertion leaf ('^', '$', 'b' or 'B'): it has a position, but
+      // no symbol.
+      node* create_assertion(uint8_t kind);
+
+      // Create leaf which matches the bytes set in the bitmap 'bytes'.
+      node* create_byte_class(const uint64_t* bytes);
+
+      // Create subtree which matches a character (a code point in UTF-8
+      // mode).
+      node* create_character(uint32_t c);
+
       // Create character class subtree.
-      node* create_char_class_subtree(const bool* chars, size_t size);
+      node* create_char_class(const bool* chars,
+                              code_point_ranges& ranges,
+                              bool negated);
+
+      // Create subtree which matches the UTF-8 encoding of the code points
+      // in 'ranges' (sorted, disjoint, >= 0x80 and without surrogates).
+      node* create_utf8_class(const code_point_ranges& ranges);
 
       // Add (symbol, position) pair.
       bool add(symbol s, position p);
 
       // Add node.
-      static bool add(nodes& nodes, node* n, const char*& regex);
+      bool add(nodes& nodes, node* n, const char*& regex);
 
       // Get escape character.
       static uint8_t escape_character(uint8_t c);
@@ -61,16 +246,34 @@ namespace lex {
 
   inline regular_expression::regular_expression()
     : _M_root(nullptr),
+      _M_nodes(nullptr),
+      _M_nnodes(0),
       _M_npositions(0),
-      _M_nsymbols(0)
+      _M_nsymbols(0),
+      _M_expansion_limit(default_expansion_limit),
+      _M_expanded(0),
+      _M_ngroups(0),
+      _M_flags(0)
   {
   }
 
   inline regular_expression::~regular_expression()
   {
-    if (_M_root) {
-      delete _M_root;
-    }
+  }
+
+  inline void regular_expression::set_expansion_limit(size_t limit)
+  {
+    _M_expansion_limit = limit;
+  }
+
+  inline void regular_expression::set_flags(unsigned flags)
+  {
+    _M_flags = flags;
+  }
+
+  inline unsigned regular_expression::flags() const
+  {
+    return _M_flags;
   }
 
   inline const node* regular_expression::root() const
@@ -78,6 +281,16 @@ namespace lex {
     return _M_root;
   }
 
+  inline size_t regular_expression::number_nodes() const
+  {
+    return _M_nnodes;
+  }
+
+  inline const node* regular_expression::get_node(size_t idx) const
+  {
+    return _M_nodes[idx];
+  }
+
   inline size_t regular_expression::number_positions() const
   {
     return _M_npositions;
@@ -98,6 +311,11 @@ namespace lex {
     return _M_symbols[idx].p;
   }
 
+  inline size_t regular_expression::number_groups() const
+  {
+    return _M_ngroups;
+  }
+
   inline uint8_t regular_expression::escape_character(uint8_t c)
   {
     switch (c) {
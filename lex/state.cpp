@@ -1,13 +1,22 @@
 #include "lex/state.h"
 
-bool lex::states::add(state* s)
+void lex::states::clear()
+{
+  for (size_t i = 0; i < _M_used; i++) {
+    _M_states[i]->state = position_set::no_state;
+  }
+
+  _M_used = 0;
+}
+
+bool lex::states::add(position_set* s)
 {
   if (_M_used == _M_size) {
     size_t size = (_M_size > 0) ? (_M_size * 2) : 32;
 
-    state** tmpstates;
-    if ((tmpstates = static_cast<state**>(
-                       realloc(_M_states, size * sizeof(state*))
+    position_set** tmpstates;
+    if ((tmpstates = static_cast<position_set**>(
+                       realloc(_M_states, size * sizeof(position_set*))
                      )) != nullptr) {
       _M_states = tmpstates;
       _M_size = size;
@@ -16,6 +25,8 @@ bool lex::states::add(state* s)
     }
   }
 
+  s->state = _M_used;
+
   _M_states[_M_used++] = s;
 
   return true;
@@ -1,21 +1,27 @@
 #ifndef LEX_STATE_H
 #define LEX_STATE_H
 
-#include <memory>
 #include "lex/position.h"
+#include "lex/position_set.h"
+#include "lex/arena.h"
 
 namespace lex {
+  // Set of positions under construction (e.g. U in the subset construction),
+  // which is interned in a position_pool once it is complete.
   class state {
     public:
       // Constructor.
-      state();
+      // If 'a' is not null, the positions are allocated from the arena.
+      state(arena* a = nullptr);
+
+      // Move constructor.
+      state(state&& other) = default;
 
       // Destructor.
       ~state() = default;
 
-      // Create.
-      static state* create(const positions& p);
-      static state* create(const state& s);
+      // Move assignment operator.
+      state& operator=(state&& other) = default;
 
       // Clear.
       void clear();
@@ -34,6 +40,7 @@ namespace lex {
 
       // Add positions.
       bool add(const positions& p);
+      bool add(const position_set& p);
 
       // Remove position.
       bool remove(position p);
@@ -41,32 +48,35 @@ namespace lex {
       // Get position.
       position get(size_t idx) const;
 
+      // Get positions.
+      const positions& get_positions() const;
+
       // Has the position been inserted?
       bool contains(position p) const;
 
-      // Marked?
-      bool marked() const;
-
-      // Mark.
-      void mark();
-
       // Print.
       void print() const;
 
     private:
       positions _M_positions;
-
-      bool _M_marked;
   };
 
+  // Dstates: the DFA states, as interned sets of positions. The index of a
+  // state is saved in its set, so looking up a set is O(1).
   class states {
     public:
       // Constructor.
       states();
 
+      // Move constructor.
+      states(states&& other);
+
       // Destructor.
       ~states();
 
+      // Move assignment operator.
+      states& operator=(states&& other);
+
       // Clear.
       void clear();
 
@@ -76,51 +86,36 @@ namespace lex {
       // Get number of states.
       size_t size() const;
 
-      // Add state.
-      bool add(state* s);
+      // Add state (it must not have been added to any container).
+      bool add(position_set* s);
 
       // Get state.
-      const state* get(size_t idx) const;
-      state* get(size_t idx);
+      const position_set* get(size_t idx) const;
 
       // Has the state been inserted?
-      bool contains(const state& s) const;
+      bool contains(const position_set* s) const;
+
+      // Find state.
+      bool find(const position_set* s, size_t& idx) const;
 
     private:
-      state** _M_states;
+      position_set** _M_states;
       size_t _M_size;
       size_t _M_used;
-  };
-
-  inline state::state()
-    : _M_marked(false)
-  {
-  }
-
-  inline state* state::create(const positions& p)
-  {
-    state* s;
-    if ((s = new (std::nothrow) state()) != nullptr) {
-      if (s->add(p)) {
-        return s;
-      }
 
-      delete s;
-    }
-
-    return nullptr;
-  }
+      // Disable copy constructor and assignment operator.
+      states(const states&) = delete;
+      states& operator=(const states&) = delete;
+  };
 
-  inline state* state::create(const state& s)
+  inline state::state(arena* a)
+    : _M_positions(a)
   {
-    return create(s._M_positions);
   }
 
   inline void state::clear()
   {
     _M_positions.clear();
-
-    _M_marked = false;
   }
 
   inline bool state::empty() const
@@ -148,6 +143,11 @@ namespace lex {
     return _M_positions.add(p);
   }
 
+  inline bool state::add(const position_set& p)
+  {
+    return _M_positions.add(p.data, p.size);
+  }
+
   inline bool state::remove(position p)
   {
     return _M_positions.remove(p);
@@ -158,19 +158,14 @@ namespace lex {
     return _M_positions.get(idx);
   }
 
-  inline bool state::contains(position p) const
-  {
-    return _M_positions.contains(p);
-  }
-
-  inline bool state::marked() const
+  inline const positions& state::get_positions() const
   {
-    return _M_marked;
+    return _M_positions;
   }
 
-  inline void state::mark()
+  inline bool state::contains(position p) const
   {
-    _M_marked = true;
+    return _M_positions.contains(p);
   }
 
   inline void state::print() const
@@ -187,26 +182,40 @@ namespace lex {
   {
   }
 
+  inline states::states(states&& other)
+    : _M_states(other._M_states),
+      _M_size(other._M_size),
+      _M_used(other._M_used)
+  {
+    other._M_states = nullptr;
+    other._M_size = 0;
+    other._M_used = 0;
+  }
+
   inline states::~states()
   {
     if (_M_states) {
-      for (size_t i = 0; i < _M_used; i++) {
-        delete _M_states[i];
-      }
-
       free(_M_states);
     }
   }
 
-  inline void states::clear()
+  inline states& states::operator=(states&& other)
   {
-    if (_M_states) {
-      for (size_t i = 0; i < _M_used; i++) {
-        delete _M_states[i];
+    if (this != &other) {
+      if (_M_states) {
+        free(_M_states);
       }
 
-      _M_used = 0;
+      _M_states = other._M_states;
+      _M_size = other._M_size;
+      _M_used = other._M_used;
+
+      other._M_states = nullptr;
+      other._M_size = 0;
+      other._M_used = 0;
     }
+
+    return *this;
   }
 
   inline bool states::empty() const
@@ -219,22 +228,22 @@ namespace lex {
     return _M_used;
   }
 
-  inline const state* states::get(size_t idx) const
+  inline const position_set* states::get(size_t idx) const
   {
     return _M_states[idx];
   }
 
-  inline state* states::get(size_t idx)
+  inline bool states::contains(const position_set* s) const
   {
-    return _M_states[idx];
+    size_t idx;
+    return find(s, idx);
   }
 
-  inline bool states::contains(const state& s) const
+  inline bool states::find(const position_set* s, size_t& idx) const
   {
-    for (size_t i = 0; i < _M_used; i++) {
-      if (s == *_M_states[i]) {
-        return true;
-      }
+    if ((s->state < _M_used) && (_M_states[s->state] == s)) {
+      idx = s->state;
+      return true;
     }
 
     return false;
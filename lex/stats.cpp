@@ -0,0 +1,39 @@
+#include "lex/stats.h"
+
+#ifdef __GLIBC__
+  #include <malloc.h>
+#endif
+
+void lex::stats::print(FILE* file) const
+{
+  fprintf(file, "Positions: %zu.\n", positions);
+  fprintf(file, "Syntax tree nodes: %zu.\n", nodes);
+  fprintf(file, "Distinct symbols: %zu.\n", symbols);
+  fprintf(file, "Total followpos size: %zu.\n", followpos);
+  fprintf(file, "Distinct followpos sets: %zu.\n", followpos_sets);
+  fprintf(file, "Distinct position sets: %zu.\n", position_sets);
+  fprintf(file, "DFA states: %zu.\n", states);
+  fprintf(file, "DFA transitions: %zu.\n", transitions);
+
+  if (engine) {
+    fprintf(file, "Engine: %s.\n", engine);
+    fprintf(file, "Estimated DFA states: %zu.\n", estimated_states);
+  }
+
+  fprintf(file, "Peak bytes allocated: %zu.\n", peak_bytes);
+  fprintf(file, "Parse time: %.6f s.\n", parse_time);
+  fprintf(file, "Nullable/firstpos/lastpos time: %.6f s.\n", init_time);
+  fprintf(file, "Followpos time: %.6f s.\n", followpos_time);
+  fprintf(file, "Subset construction time: %.6f s.\n", subset_time);
+}
+
+size_t lex::stats::heap_in_use()
+{
+#if defined(__GLIBC__) && \
+    ((__GLIBC__ > 2) || ((__GLIBC__ == 2) && (__GLIBC_MINOR__ >= 33)))
+  struct mallinfo2 mi = mallinfo2();
+  return mi.uordblks + mi.hblkhd;
+#else
+  return 0;
+#endif
+}
@@ -0,0 +1,100 @@
+#ifndef LEX_STATS_H
+#define LEX_STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+namespace lex {
+  // Construction statistics, filled in by regular_expression::parse(),
+  // dfa::build() and matcher::compile().
+  struct stats {
+    // Syntax tree.
+    size_t positions;
+    size_t nodes;
+    size_t symbols;
+
+    // Sum of the sizes of the followpos sets.
+    size_t followpos;
+
+    // Distinct followpos sets and distinct sets of positions (followpos sets
+    // and DFA states), which are stored only once.
+    size_t followpos_sets;
+    size_t position_sets;
+
+    // DFA (the dead state is not counted).
+    size_t states;
+    size_t transitions;
+
+    // Engine chosen by matcher::compile() (null if none) and estimated
+    // number of DFA states (see analysis).
+    const char* engine;
+    size_t estimated_states;
+
+    // Peak heap usage since the beginning of the parse (sampled at the phase
+    // boundaries).
+    size_t peak_bytes;
+
+    // Wall time per phase (seconds).
+    double parse_time;
+    double init_time; // nullable, firstpos and lastpos.
+    double followpos_time;
+    double subset_time;
+
+    // Heap usage at the beginning of the parse.
+    size_t heap_base;
+
+    // Constructor.
+    stats();
+
+    // Sample heap usage and update peak_bytes.
+    void sample_heap();
+
+    // Print.
+    void print(FILE* file = stdout) const;
+
+    // Get current time (seconds).
+    static double now();
+
+    // Get the number of bytes currently allocated in the heap.
+    static size_t heap_in_use();
+  };
+
+  inline stats::stats()
+    : positions(0),
+      nodes(0),
+      symbols(0),
+      followpos(0),
+      followpos_sets(0),
+      position_sets(0),
+      states(0),
+      transitions(0),
+      engine(nullptr),
+      estimated_states(0),
+      peak_bytes(0),
+      parse_time(0.0),
+      init_time(0.0),
+      followpos_time(0.0),
+      subset_time(0.0),
+      heap_base(heap_in_use())
+  {
+  }
+
+  inline void stats::sample_heap()
+  {
+    size_t used = heap_in_use();
+    if ((used > heap_base) && (used - heap_base > peak_bytes)) {
+      peak_bytes = used - heap_base;
+    }
+  }
+
+  inline double stats::now()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + (ts.tv_nsec / 1000000000.0);
+  }
+}
+
+#endif // LEX_STATS_H
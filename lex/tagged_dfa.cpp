@@ -0,0 +1,504 @@
+#include <string.h>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+#include "lex/tagged_dfa.h"
+#include "lex/position_set.h"
+
+const size_t lex::tagged_dfa::no_offset;
+const uint32_t lex::tagged_dfa::no_slot;
+
+namespace {
+  // Range of positions of a subtree (the leaves are numbered in post-order,
+  // so the positions of a subtree are consecutive).
+  struct range {
+    lex::position first;
+    lex::position last;
+  };
+
+  typedef std::unordered_map<const lex::node*, range> ranges;
+
+  // Tagged link of followpos: the tags [first, first + count) are crossed
+  // when going to the position 'q'.
+  struct link {
+    lex::position q;
+    uint32_t first;
+    uint32_t count;
+  };
+
+  // Candidate of the construction of a transition.
+  struct item {
+    lex::position q;
+    uint32_t slot;
+    uint32_t first;
+    uint32_t count;
+  };
+
+  inline uint16_t opening_tag(lex::position group)
+  {
+    return static_cast<uint16_t>(2 * (group - 1));
+  }
+
+  inline uint16_t closing_tag(lex::position group)
+  {
+    return static_cast<uint16_t>(2 * (group - 1) + 1);
+  }
+
+  inline bool contains(const ranges& r, const lex::node* n, lex::position p)
+  {
+    const range& rg = r.find(n)->second;
+    return (p >= rg.first) && (p <= rg.last);
+  }
+
+  // Add the tags of the groups which match the empty string when the
+  // (nullable) subtree 'n' is skipped.
+  void null_tags(const lex::node* n, std::vector<uint16_t>& tags)
+  {
+    std::vector<const lex::node*> stack(1, n);
+
+    while (!stack.empty()) {
+      const lex::node* top = stack.back();
+      stack.pop_back();
+
+      switch (top->t) {
+        case lex::node::type::group:
+          tags.push_back(opening_tag(top->pos));
+          tags.push_back(closing_tag(top->pos));
+
+          stack.push_back(top->left);
+          break;
+        case lex::node::type::concatenation:
+          stack.push_back(top->left);
+          stack.push_back(top->right);
+          break;
+        case lex::node::type::alternation:
+          // The first alternative which matches the empty string.
+          stack.push_back(top->left->nullable ? top->left : top->right);
+          break;
+        case lex::node::type::repetition_one_or_more:
+          stack.push_back(top->left);
+          break;
+        case lex::node::type::repetition_zero_or_more:
+        case lex::node::type::optional:
+          // If x matches the empty string, x* and x? match it with an
+          // (empty) iteration of x, as in POSIX.
+          if (top->left->nullable) {
+            stack.push_back(top->left);
+          }
+
+          break;
+        default:
+          break;
+      }
+    }
+  }
+
+  // Add the tags which are crossed when entering the subtree 'n' at the
+  // position 'q' (of firstpos(n)).
+  void enter_tags(const ranges& r,
+                  const lex::node* n,
+                  lex::position q,
+                  std::vector<uint16_t>& tags)
+  {
+    while (!n->leaf()) {
+      switch (n->t) {
+        case lex::node::type::group:
+          tags.push_back(opening_tag(n->pos));
+          n = n->left;
+          break;
+        case lex::node::type::concatenation:
+          if (contains(r, n->left, q)) {
+            n = n->left;
+          } else {
+            // The left operand is skipped.
+            null_tags(n->left, tags);
+            n = n->right;
+          }
+
+          break;
+        case lex::node::type::alternation:
+          n = contains(r, n->left, q) ? n->left : n->right;
+          break;
+        default:
+          n = n->left;
+      }
+    }
+  }
+
+  // Add the tags which are crossed when leaving the subtree 'n' from the
+  // position 'p' (of lastpos(n)). The order of the groups doesn't matter,
+  // only the order of the tags of each group.
+  void exit_tags(const ranges& r,
+                 const lex::node* n,
+                 lex::position p,
+                 std::vector<uint16_t>& tags)
+  {
+    while (!n->leaf()) {
+      switch (n->t) {
+        case lex::node::type::group:
+          tags.push_back(closing_tag(n->pos));
+          n = n->left;
+          break;
+        case lex::node::type::concatenation:
+          if (contains(r, n->left, p)) {
+            // The right operand is skipped.
+            null_tags(n->right, tags);
+            n = n->left;
+          } else {
+            n = n->right;
+          }
+
+          break;
+        case lex::node::type::alternation:
+          n = contains(r, n->left, p) ? n->left : n->right;
+          break;
+        default:
+          n = n->left;
+      }
+    }
+  }
+}
+
+bool lex::tagged_dfa::build(const regular_expression& regex)
+{
+  _M_dtran.clear();
+  _M_rows.clear();
+  _M_final.clear();
+  _M_targets.clear();
+  _M_candidates.clear();
+  _M_tags.clear();
+
+  _M_max_rows = 0;
+
+  // The assertions (^, $, \b and \B) are not supported.
+  const node* root;
+  if (((root = regex.root()) == nullptr) || (regex.has_assertions())) {
+    return false;
+  }
+
+  // The tags are 16-bit.
+  if ((_M_ngroups = regex.number_groups()) > 0x7fff) {
+    return false;
+  }
+
+  _M_ntags = 2 * _M_ngroups;
+
+  // Byte classes.
+  memset(_M_classes, 0, sizeof(_M_classes));
+
+  for (size_t i = 0; i < regex.number_symbols(); i++) {
+    _M_classes[regex.get_symbol(i)] = i + 1;
+  }
+
+  _M_nclasses = regex.number_symbols() + 1;
+
+  // Compute the range of positions of each subtree.
+  ranges r;
+  r.reserve(regex.number_nodes());
+
+  for (size_t i = 0; i < regex.number_nodes(); i++) {
+    const node* n = regex.get_node(i);
+
+    if (n->leaf()) {
+      r[n] = {n->pos, n->pos};
+    } else {
+      r[n] = {r[n->left].first, r[n->right ? n->right : n->left].last};
+    }
+  }
+
+  // Tagged links of followpos (by source position).
+  std::vector<std::vector<link>> links(regex.number_positions());
+  std::vector<uint16_t> tags;
+  std::vector<uint16_t> exit;
+
+  for (size_t i = 0; i < regex.number_nodes(); i++) {
+    const node* n = regex.get_node(i);
+
+    const node* from;
+    const node* to;
+
+    switch (n->t) {
+      case node::type::concatenation:
+        from = n->left;
+        to = n->right;
+        break;
+      case node::type::repetition_zero_or_more:
+      case node::type::repetition_one_or_more:
+        from = n->left;
+        to = n->left;
+        break;
+      default:
+        continue;
+    }
+
+    for (size_t j = 0; j < from->lastpos.size(); j++) {
+      position p = from->lastpos.get(j);
+
+      exit.clear();
+      exit_tags(r, from, p, exit);
+
+      for (size_t k = 0; k < to->firstpos.size(); k++) {
+        position q = to->firstpos.get(k);
+
+        tags = exit;
+        enter_tags(r, to, q, tags);
+
+        links[p].push_back({q,
+                            static_cast<uint32_t>(_M_tags.size()),
+                            static_cast<uint32_t>(tags.size())});
+
+        _M_tags.insert(_M_tags.end(), tags.begin(), tags.end());
+      }
+    }
+  }
+
+  // Subset construction: the sets of positions double as the rows of
+  // registers of the states.
+  arena a;
+  position_pool pool(&a);
+
+  std::vector<const position_set*> sets;
+
+  // Dead state.
+  sets.push_back(nullptr);
+  _M_rows.push_back(0);
+  _M_final.push_back(no_slot);
+
+  position endmark = regex.number_positions() - 1;
+
+  position_set* initial;
+  if ((initial = pool.intern(root->firstpos)) == nullptr) {
+    return false;
+  }
+
+  initial->state = sets.size();
+  sets.push_back(initial);
+
+  _M_start = initial->state;
+
+  // The rows of the start state are entered from no row.
+  _M_initial = _M_targets.size();
+
+  for (size_t j = 0; j < initial->size; j++) {
+    tags.clear();
+    enter_tags(r, root, initial->data[j], tags);
+
+    _M_targets.push_back({static_cast<uint32_t>(_M_candidates.size()), 1});
+    _M_candidates.push_back({no_slot,
+                             static_cast<uint32_t>(_M_tags.size()),
+                             static_cast<uint32_t>(tags.size())});
+
+    _M_tags.insert(_M_tags.end(), tags.begin(), tags.end());
+  }
+
+  std::vector<item> items;
+  std::vector<position> u;
+
+  for (size_t s = 1; s < sets.size(); s++) {
+    const position_set* set = sets[s];
+
+    _M_rows.push_back(set->size);
+    _M_final.push_back(set->contains(endmark) ? set->size - 1 : no_slot);
+
+    _M_max_rows = std::max(_M_max_rows, set->size);
+
+    // Class 0 leads to the dead state.
+    _M_dtran.push_back({compiled_dfa::dead_state, 0});
+
+    for (size_t cls = 1; cls < _M_nclasses; cls++) {
+      const positions& p = regex.get_positions(cls - 1);
+
+      items.clear();
+
+      for (size_t j = 0; j < set->size; j++) {
+        if (p.contains(set->data[j])) {
+          for (const link& l : links[set->data[j]]) {
+            items.push_back({l.q, static_cast<uint32_t>(j), l.first, l.count});
+          }
+        }
+      }
+
+      if (items.empty()) {
+        _M_dtran.push_back({compiled_dfa::dead_state, 0});
+        continue;
+      }
+
+      std::stable_sort(items.begin(),
+                       items.end(),
+                       [](const item& a, const item& b) {
+                         return a.q < b.q;
+                       });
+
+      u.clear();
+
+      for (const item& i : items) {
+        if ((u.empty()) || (u.back() != i.q)) {
+          u.push_back(i.q);
+        }
+      }
+
+      position_set* next;
+      if ((next = pool.intern(u.data(),
+                              u.size(),
+                              position_pool::hash(u.data(), u.size()))) ==
+          nullptr) {
+        return false;
+      }
+
+      if (next->state == position_set::no_state) {
+        next->state = sets.size();
+        sets.push_back(next);
+      }
+
+      _M_dtran.push_back({static_cast<state_id>(next->state),
+                          static_cast<uint32_t>(_M_targets.size())});
+
+      // One target per row of the next state, with its candidates.
+      for (size_t i = 0; i < items.size(); ) {
+        size_t j = i;
+
+        do {
+          _M_candidates.push_back({items[j].slot,
+                                   items[j].first,
+                                   items[j].count});
+        } while ((++j < items.size()) && (items[j].q == items[i].q));
+
+        _M_targets.push_back({static_cast<uint32_t>(_M_candidates.size() -
+                                                    (j - i)),
+                              static_cast<uint32_t>(j - i)});
+
+        i = j;
+      }
+    }
+  }
+
+  // Transitions of the dead state.
+  _M_dtran.insert(_M_dtran.begin(),
+                  _M_nclasses,
+                  {compiled_dfa::dead_state, 0});
+
+  return true;
+}
+
+bool lex::tagged_dfa::match(const void* buf,
+                            size_t len,
+                            tag_context& ctx,
+                            size_t* captures) const
+{
+  return run(static_cast<const uint8_t*>(buf),
+             len,
+             0,
+             true,
+             ctx,
+             captures) != no_offset;
+}
+
+bool lex::tagged_dfa::search(const void* buf,
+                             size_t len,
+                             tag_context& ctx,
+                             size_t* captures) const
+{
+  for (size_t start = 0; start <= len; start++) {
+    if (run(static_cast<const uint8_t*>(buf),
+            len,
+            start,
+            false,
+            ctx,
+            captures) != no_offset) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void lex::tagged_dfa::apply(uint32_t first,
+                            state_id next,
+                            const size_t* cur,
+                            size_t* rows,
+                            size_t offset,
+                            size_t* scratch) const
+{
+  for (size_t j = 0; j < _M_rows[next]; j++) {
+    const target& t = _M_targets[first + j];
+    size_t* row = rows + j * _M_ntags;
+
+    for (size_t c = 0; c < t.count; c++) {
+      const candidate& cand = _M_candidates[t.first + c];
+
+      // The first candidate is built in place, the others in the scratch
+      // row.
+      size_t* dest = (c == 0) ? row : scratch;
+
+      if (cand.slot != no_slot) {
+        memcpy(dest, cur + cand.slot * _M_ntags, _M_ntags * sizeof(size_t));
+      } else {
+        std::fill(dest, dest + _M_ntags, no_offset);
+      }
+
+      for (size_t k = 0; k < cand.count; k++) {
+        uint16_t tag = _M_tags[cand.first + k];
+        dest[tag] = offset;
+
+        // Opening a group clears its end.
+        if ((tag & 1) == 0) {
+          dest[tag + 1] = no_offset;
+        }
+      }
+
+      if ((c > 0) && (better(scratch, row))) {
+        memcpy(row, scratch, _M_ntags * sizeof(size_t));
+      }
+    }
+  }
+}
+
+size_t lex::tagged_dfa::run(const uint8_t* buf,
+                            size_t len,
+                            size_t start,
+                            bool anchored_end,
+                            tag_context& ctx,
+                            size_t* captures) const
+{
+  if (_M_start == compiled_dfa::dead_state) {
+    return no_offset;
+  }
+
+  size_t* cur = ctx._M_current;
+  size_t* next = ctx._M_next;
+
+  state_id s = _M_start;
+  apply(_M_initial, s, nullptr, cur, start, ctx._M_scratch);
+
+  size_t end = no_offset;
+
+  for (size_t i = start; ; i++) {
+    // Save the offsets of the longest match so far.
+    if ((_M_final[s] != no_slot) && ((!anchored_end) || (i == len))) {
+      captures[0] = start;
+      captures[1] = i;
+
+      memcpy(captures + 2,
+             cur + _M_final[s] * _M_ntags,
+             _M_ntags * sizeof(size_t));
+
+      end = i;
+    }
+
+    if (i == len) {
+      break;
+    }
+
+    const transition& t = _M_dtran[(s * _M_nclasses) + _M_classes[buf[i]]];
+    if (t.next == compiled_dfa::dead_state) {
+      break;
+    }
+
+    apply(t.first, t.next, cur, next, i + 1, ctx._M_scratch);
+
+    std::swap(cur, next);
+    s = t.next;
+  }
+
+  return end;
+}
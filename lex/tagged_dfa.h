@@ -0,0 +1,244 @@
+#ifndef LEX_TAGGED_DFA_H
+#define LEX_TAGGED_DFA_H
+
+#include <stdint.h>
+#include <vector>
+#include "lex/regular_expression.h"
+#include "lex/compiled_dfa.h"
+
+namespace lex {
+  class tag_context;
+
+  // Tagged DFA: a DFA which extracts the offsets of the capture groups in
+  // the same pass as the match (see regular_expression::captures).
+  //
+  // Each group k has two tags (its opening and its closing parenthesis).
+  // The links of followpos are labelled with the tags which are crossed
+  // when going from one position to the next one (in order), and every DFA
+  // state keeps a row of registers (the value of each tag) per position of
+  // its set. Each transition carries the register operations: for every
+  // position of the target state, the candidate rows of the source state
+  // and the tags which are set to the current offset (opening a group
+  // clears its end). When several candidates reach the same position, the
+  // best one is kept: for each group in order, the latest end and then the
+  // earliest start (a group in a repetition keeps the offsets of its last
+  // iteration). The subexpressions outside the groups have no tags, so
+  // they get no priority, unlike in POSIX (e.g. x*(a|xa) on "xxa" gives
+  // group 1 = [1, 3), POSIX gives [2, 3)).
+  //
+  // The tagged DFA is immutable once built, the registers live in the
+  // match contexts (one per thread).
+  class tagged_dfa {
+    public:
+      // Offset of a group which doesn't participate in the match.
+      static const size_t no_offset = static_cast<size_t>(-1);
+
+      // Constructor.
+      tagged_dfa();
+
+      // Destructor.
+      ~tagged_dfa();
+
+      // Build from a regular expression parsed with the flag
+      // regular_expression::captures.
+      bool build(const regular_expression& regex);
+
+      // Get number of capture groups (group 0, the whole match, is not
+      // counted).
+      size_t number_groups() const;
+
+      // Get number of states (including the dead state).
+      size_t number_states() const;
+
+      // Get number of registers of a match context.
+      size_t number_registers() const;
+
+      // Does the whole input match? If so, 'captures' (an array of
+      // 2 * (number_groups() + 1) offsets) receives the start and the end
+      // of each group.
+      bool match(const void* buf,
+                 size_t len,
+                 tag_context& ctx,
+                 size_t* captures) const;
+
+      // Search the leftmost-longest match and get the offsets of its groups.
+      bool search(const void* buf,
+                  size_t len,
+                  tag_context& ctx,
+                  size_t* captures) const;
+
+    private:
+      friend class tag_context;
+
+      // No row of registers (the candidate of the start state).
+      static const uint32_t no_slot = static_cast<uint32_t>(-1);
+
+      // Candidate row of a register operation: the row 'slot' of the source
+      // state, with the tags [first, first + count) of _M_tags set to the
+      // current offset (in order).
+      struct candidate {
+        uint32_t slot;
+        uint32_t first;
+        uint32_t count;
+      };
+
+      // Candidates [first, first + count) of _M_candidates for a row of the
+      // target state.
+      struct target {
+        uint32_t first;
+        uint32_t count;
+      };
+
+      // Transition: the rows of the next state are computed by the targets
+      // [first, first + number of rows of next) of _M_targets.
+      struct transition {
+        state_id next;
+        uint32_t first;
+      };
+
+      // Byte classes: class 0 groups the characters which don't appear in the
+      // regular expression, class i + 1 is the symbol i of the regular
+      // expression.
+      uint16_t _M_classes[256];
+      size_t _M_nclasses;
+
+      // Transition table (number of states x _M_nclasses).
+      std::vector<transition> _M_dtran;
+
+      // Number of rows of registers of each state (the size of its set of
+      // positions).
+      std::vector<uint32_t> _M_rows;
+
+      // Row of the endmark of each state (no_slot if it is not accepting).
+      std::vector<uint32_t> _M_final;
+
+      std::vector<target> _M_targets;
+      std::vector<candidate> _M_candidates;
+      std::vector<uint16_t> _M_tags;
+
+      // Targets of the rows of the start state.
+      uint32_t _M_initial;
+
+      state_id _M_start;
+
+      size_t _M_ngroups;
+      size_t _M_ntags;
+
+      // Maximum number of rows of a state.
+      size_t _M_max_rows;
+
+      // Compute the rows of the state 'next' from the rows 'cur' with the
+      // targets starting at 'first'.
+      void apply(uint32_t first,
+                 state_id next,
+                 const size_t* cur,
+                 size_t* rows,
+                 size_t offset,
+                 size_t* scratch) const;
+
+      // Is the row 'a' better than the row 'b'? Only the groups are compared
+      // (see the policy above).
+      bool better(const size_t* a, const size_t* b) const;
+
+      // Run the tagged DFA from 'start'. Returns the end of the longest match
+      // (or no_offset) and saves the offsets of its groups in 'captures'.
+      size_t run(const uint8_t* buf,
+                 size_t len,
+                 size_t start,
+                 bool anchored_end,
+                 tag_context& ctx,
+                 size_t* captures) const;
+
+      // Disable copy constructor and assignment operator.
+      tagged_dfa(const tagged_dfa&) = delete;
+      tagged_dfa& operator=(const tagged_dfa&) = delete;
+  };
+
+  // Registers of a match of a tagged DFA, allocated once (when the context
+  // is created) and reused by every match. Each thread uses its own
+  // contexts, the tagged DFA is shared.
+  class tag_context {
+    public:
+      // Constructor.
+      tag_context(const tagged_dfa& d);
+
+    private:
+      friend class tagged_dfa;
+
+      // Two banks of rows (the current state and the next one) and a
+      // scratch row.
+      std::vector<size_t> _M_registers;
+
+      size_t* _M_current;
+      size_t* _M_next;
+      size_t* _M_scratch;
+
+      // Disable copy constructor and assignment operator.
+      tag_context(const tag_context&) = delete;
+      tag_context& operator=(const tag_context&) = delete;
+  };
+
+  inline tagged_dfa::tagged_dfa()
+    : _M_nclasses(0),
+      _M_initial(0),
+      _M_start(compiled_dfa::dead_state),
+      _M_ngroups(0),
+      _M_ntags(0),
+      _M_max_rows(0)
+  {
+  }
+
+  inline tagged_dfa::~tagged_dfa()
+  {
+  }
+
+  inline size_t tagged_dfa::number_groups() const
+  {
+    return _M_ngroups;
+  }
+
+  inline size_t tagged_dfa::number_states() const
+  {
+    return _M_rows.size();
+  }
+
+  inline size_t tagged_dfa::number_registers() const
+  {
+    return (2 * _M_max_rows + 1) * _M_ntags;
+  }
+
+  inline bool tagged_dfa::better(const size_t* a, const size_t* b) const
+  {
+    for (size_t i = 0; i < _M_ntags; i += 2) {
+      // The latest end: a group which hasn't been closed yet will end
+      // later, a group which hasn't been opened is the worst.
+      if (a[i + 1] != b[i + 1]) {
+        if (a[i] == no_offset) {
+          return false;
+        } else if (b[i] == no_offset) {
+          return true;
+        }
+
+        return (a[i + 1] == no_offset) ||
+               ((b[i + 1] != no_offset) && (a[i + 1] > b[i + 1]));
+      }
+
+      // The earliest start (unset is the worst).
+      if (a[i] != b[i]) {
+        return a[i] < b[i];
+      }
+    }
+
+    return false;
+  }
+
+  inline tag_context::tag_context(const tagged_dfa& d)
+    : _M_registers(d.number_registers() + 1),
+      _M_current(_M_registers.data()),
+      _M_next(_M_current + d._M_max_rows * d._M_ntags),
+      _M_scratch(_M_next + d._M_max_rows * d._M_ntags)
+  {
+  }
+}
+
+#endif // LEX_TAGGED_DFA_H
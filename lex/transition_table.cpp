@@ -4,33 +4,56 @@
 
 lex::transition_table::~transition_table()
 {
-  if (_M_nodes) {
-    for (size_t i = 0; i < _M_used; i++) {
-      delete _M_nodes[i].s;
-
-      for (size_t j = 0; j < _M_nodes[i].trans.ntrans; j++) {
-        delete _M_nodes[i].trans.trans[j].u;
-      }
-    }
+  clear();
+}
 
+void lex::transition_table::clear()
+{
+  if (_M_nodes) {
     free(_M_nodes);
+
+    _M_nodes = nullptr;
+    _M_size = 0;
+    _M_used = 0;
   }
+
+  _M_arena.clear();
 }
 
-bool lex::transition_table::add(const state& s, symbol a, state* u)
+bool lex::transition_table::add(const position_set* s,
+                                symbol a,
+                                const position_set* u)
 {
+  // Getting u might reallocate the nodes.
   node* n;
-  if (((n = add(s)) != nullptr) && (n->trans.ntrans < max_transitions)) {
-    transition* trans = n->trans.trans + n->trans.ntrans;
+  if (((get(u)) != nullptr) &&
+      ((n = get(s)) != nullptr) &&
+      (n->trans.ntrans < max_transitions)) {
+    if (n->trans.ntrans == n->trans.size) {
+      size_t size = (n->trans.size > 0) ? (n->trans.size * 2) : 4;
+
+      // The transitions of a state are added consecutively, so they are
+      // usually the last allocation of the arena and they grow in place.
+      transition* trans;
+      if ((trans = static_cast<transition*>(
+                     _M_arena.reallocate(n->trans.trans,
+                                         n->trans.size * sizeof(transition),
+                                         size * sizeof(transition),
+                                         alignof(transition))
+                   )) == nullptr) {
+        return false;
+      }
 
-    trans->a = a;
-    trans->u = u;
+      n->trans.trans = trans;
+      n->trans.size = size;
+    }
 
-    if (add(*u)) {
-      n->trans.ntrans++;
+    transition* trans = n->trans.trans + n->trans.ntrans++;
 
-      return true;
-    }
+    trans->a = a;
+    trans->u = u->state;
+
+    return true;
   }
 
   return false;
@@ -62,7 +85,7 @@ void lex::transition_table::print(position endmark) const
         printf("\t0x%02x -> ", n->trans.trans[j].a);
       }
 
-      n->trans.trans[j].u->print();
+      _M_nodes[n->trans.trans[j].u].s->print();
       printf("\n");
     }
 
@@ -70,49 +93,47 @@ void lex::transition_table::print(position endmark) const
   }
 }
 
-lex::transition_table::node* lex::transition_table::add(const state& s)
+lex::transition_table::node* lex::transition_table::get(const position_set* s)
 {
-  // Search state s.
-  for (size_t i = 0; i < _M_used; i++) {
-    node* n = _M_nodes + i;
-
-    if (s == *n->s) {
-      return n;
-    }
+  if (!allocate_nodes(s->state + 1)) {
+    return nullptr;
   }
 
-  if (allocate_nodes()) {
-    node* n = _M_nodes + _M_used;
+  node* n = _M_nodes + s->state;
+  n->s = s;
 
-    if ((n->s = state::create(s)) != nullptr) {
-      n->trans.ntrans = 0;
-
-      _M_used++;
-
-      return n;
-    }
-  }
-
-  return nullptr;
+  return n;
 }
 
-bool lex::transition_table::allocate_nodes()
+bool lex::transition_table::allocate_nodes(size_t count)
 {
-  if (_M_used < _M_size) {
+  if (count <= _M_used) {
     return true;
   }
 
-  size_t size = (_M_size > 0) ? (_M_size * 2) : 32;
+  if (count > _M_size) {
+    size_t size = (_M_size > 0) ? (_M_size * 2) : 32;
+    while (size < count) {
+      size *= 2;
+    }
 
-  node* nodes;
-  if ((nodes = static_cast<node*>(
-                 realloc(_M_nodes, size * sizeof(node))
-               )) != nullptr) {
-    _M_nodes = nodes;
-    _M_size = size;
+    node* nodes;
+    if ((nodes = static_cast<node*>(
+                   realloc(_M_nodes, size * sizeof(node))
+                 )) != nullptr) {
+      _M_nodes = nodes;
+      _M_size = size;
+    } else {
+      return false;
+    }
+  }
 
-    return true;
+  for (; _M_used < count; _M_used++) {
+    _M_nodes[_M_used].s = nullptr;
+    _M_nodes[_M_used].trans.trans = nullptr;
+    _M_nodes[_M_used].trans.size = 0;
+    _M_nodes[_M_used].trans.ntrans = 0;
   }
 
-  return false;
+  return true;
 }
@@ -1,7 +1,8 @@
 #ifndef LEX_TRANSITION_TABLE_H
 #define LEX_TRANSITION_TABLE_H
 
-#include "lex/state.h"
+#include "lex/arena.h"
+#include "lex/position_set.h"
 #include "lex/symbol.h"
 
 namespace lex {
@@ -13,8 +14,15 @@ namespace lex {
       // Destructor.
       ~transition_table();
 
-      // Add.
-      bool add(const state& s, symbol a, state* u);
+      // Clear.
+      void clear();
+
+      // Empty?
+      bool empty() const;
+
+      // Add transition (the sets must be DFA states: the node of a set is
+      // the node with the index of the state).
+      bool add(const position_set* s, symbol a, const position_set* u);
 
       // Print transition table.
       void print(position endmark) const;
@@ -24,16 +32,20 @@ namespace lex {
 
       struct transition {
         symbol a;
-        state* u;
+
+        // Index of the target node.
+        size_t u;
       };
 
       struct transitions {
-        transition trans[max_transitions];
+        transition* trans;
+        size_t size;
         size_t ntrans;
       };
 
       struct node {
-        state* s;
+        // The sets are owned by their pool.
+        const position_set* s;
         transitions trans;
       };
 
@@ -41,11 +53,14 @@ namespace lex {
       size_t _M_size;
       size_t _M_used;
 
-      // Add.
-      node* add(const state& s);
+      // Arena for the transitions.
+      arena _M_arena;
+
+      // Get node (it is created if needed).
+      node* get(const position_set* s);
 
       // Allocate nodes.
-      bool allocate_nodes();
+      bool allocate_nodes(size_t count);
   };
 
   inline transition_table::transition_table()
@@ -54,6 +69,11 @@ namespace lex {
       _M_used(0)
   {
   }
+
+  inline bool transition_table::empty() const
+  {
+    return (_M_used == 0);
+  }
 }
 
 #endif // LEX_TRANSITION_TABLE_H
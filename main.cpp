@@ -1,21 +1,403 @@
 #include <stdlib.h>
 #include <stdio.h>
-#include "lex/dfa.h"
+#include <string.h>
+#include "lex/batch_compiler.h"
+#include "lex/compile_cache.h"
+#include "lex/tagged_dfa.h"
+#include "lex/matcher.h"
+#include "lex/case_folding.h"
+
+static void usage(const char* program)
+{
+  fprintf(stderr,
+          "Usage: %s [--stats] [--utf8] [--ignore-case] [--threads <n>] "
+          "[--reverse] <regular-expression>\n"
+          "       %s [--stats] [--utf8] [--ignore-case] [--threads <n>] "
+          "--literals <file> <regular-expression>\n"
+          "       %s [--stats] --literals <file>\n"
+          "       %s [--utf8] [--ignore-case] [--threads <n>] "
+          "--batch <file>\n"
+          "       %s [--utf8] [--ignore-case] --cache <directory> "
+          "<regular-expression>\n"
+          "       %s [--utf8] [--ignore-case] --captures <input> "
+          "<regular-expression>\n"
+          "       %s [--stats] [--utf8] [--ignore-case] --plan "
+          "<regular-expression>\n"
+          "       %s --check-case-folding\n",
+          program,
+          program,
+          program,
+          program,
+          program,
+          program,
+          program,
+          program);
+}
+
+// Load literals (one per line, empty lines are skipped).
+static bool load_literals(const char* filename,
+                          char*& data,
+                          char**& literals,
+                          size_t& count)
+{
+  FILE* file;
+  if ((file = fopen(filename, "rb")) == nullptr) {
+    return false;
+  }
+
+  bool ret = false;
+
+  long size;
+  if ((fseek(file, 0, SEEK_END) == 0) &&
+      ((size = ftell(file)) >= 0) &&
+      (fseek(file, 0, SEEK_SET) == 0) &&
+      ((data = static_cast<char*>(malloc(size + 1))) != nullptr)) {
+    if (fread(data, 1, size, file) == static_cast<size_t>(size)) {
+      data[size] = 0;
+
+      // Count lines.
+      count = 0;
+      for (long i = 0; i < size; i++) {
+        if ((data[i] == '\n') || (i == size - 1)) {
+          count++;
+        }
+      }
+
+      if ((literals = static_cast<char**>(
+                        malloc((count + 1) * sizeof(char*))
+                      )) != nullptr) {
+        count = 0;
+
+        char* line = data;
+        for (long i = 0; i < size; i++) {
+          if (data[i] == '\n') {
+            data[i] = 0;
+
+            // Remove trailing '\r' (if any).
+            if ((i > 0) && (data[i - 1] == '\r')) {
+              data[i - 1] = 0;
+            }
+
+            // Skip empty lines.
+            if (*line) {
+              literals[count++] = line;
+            }
+
+            line = data + i + 1;
+          }
+        }
+
+        if (*line) {
+          literals[count++] = line;
+        }
+
+        ret = true;
+      }
+    }
+  }
+
+  fclose(file);
+
+  return ret;
+}
+
+// Compile the regular expressions of a file (one per line) concurrently and
+// print the number of states of each DFA.
+static int compile_batch(const char* filename, unsigned flags, size_t nthreads)
+{
+  char* data = nullptr;
+  char** lines = nullptr;
+  size_t count = 0;
+
+  if (!load_literals(filename, data, lines, count)) {
+    fprintf(stderr, "Error loading regular expressions from '%s'.\n", filename);
+
+    free(lines);
+    free(data);
+
+    return -1;
+  }
+
+  std::vector<std::string> patterns(lines, lines + count);
+
+  free(lines);
+  free(data);
+
+  lex::batch_compiler compiler;
+  compiler.set_threads(nthreads);
+  compiler.set_flags(flags);
+
+  std::vector<lex::batch_compiler::result> results;
+  size_t compiled = compiler.compile(patterns, results);
+
+  for (size_t i = 0; i < results.size(); i++) {
+    if (results[i].d) {
+      printf("%zu: %zu states.\n", i + 1, results[i].d->number_states() - 1);
+    } else {
+      printf("%zu: %s: '%s'.\n",
+             i + 1,
+             results[i].error,
+             patterns[i].c_str());
+    }
+  }
+
+  return (compiled == patterns.size()) ? 0 : -1;
+}
+
+// Search the leftmost-longest match of the regular expression in the input
+// with a tagged DFA and print the offsets of its capture groups.
+static int print_captures(const char* expr, const char* input, unsigned flags)
+{
+  lex::regular_expression regex;
+  regex.set_flags(flags | lex::regular_expression::captures);
+
+  if (!regex.parse(expr)) {
+    fprintf(stderr, "Error parsing regular expression.\n");
+    return -1;
+  }
+
+  lex::tagged_dfa dfa;
+  if (!dfa.build(regex)) {
+    fprintf(stderr, "Error building tagged DFA.\n");
+    return -1;
+  }
+
+  lex::tag_context ctx(dfa);
+  std::vector<size_t> captures(2 * (dfa.number_groups() + 1));
+
+  if (!dfa.search(input, strlen(input), ctx, captures.data())) {
+    printf("No match.\n");
+    return 0;
+  }
+
+  for (size_t i = 0; i <= dfa.number_groups(); i++) {
+    size_t start = captures[2 * i];
+    size_t end = captures[2 * i + 1];
+
+    if (start != lex::tagged_dfa::no_offset) {
+      printf("Group %zu: [%zu, %zu) '%.*s'.\n",
+             i,
+             start,
+             end,
+             static_cast<int>(end - start),
+             input + start);
+    } else {
+      printf("Group %zu: no match.\n", i);
+    }
+  }
+
+  return 0;
+}
+
+// Analyze the regular expression and print the engine which the matcher
+// chooses for it.
+static int print_plan(const char* expr, unsigned flags, bool print_stats)
+{
+  lex::stats st;
+
+  lex::matcher m;
+  m.set_flags(flags);
+
+  if (!m.compile(expr, print_stats ? &st : nullptr)) {
+    fprintf(stderr, "Error compiling regular expression.\n");
+    return -1;
+  }
+
+  const lex::analysis& a = m.get_analysis();
+
+  printf("Positions: %zu.\n", a.positions);
+  printf("Character classes: %zu (widest: %zu bytes).\n",
+         a.classes,
+         a.max_class_width);
+  printf("Assertions: %s.\n", a.assertions ? "yes" : "no");
+
+  if (a.is_literal) {
+    printf("Literal: '%s'.\n", a.literal.c_str());
+  } else {
+    printf("Literal: no.\n");
+  }
+
+  if (a.assertions) {
+    printf("Estimated DFA states: unknown.\n");
+  } else if (a.estimated_states > lex::matcher::max_dfa_states) {
+    printf("Estimated DFA states: more than %zu.\n",
+           lex::matcher::max_dfa_states);
+  } else {
+    printf("Estimated DFA states: %zu.\n", a.estimated_states);
+  }
+
+  printf("Engine: %s.\n", lex::matcher::name(m.used_engine()));
+
+  if (print_stats) {
+    st.print();
+  }
+
+  return 0;
+}
+
+static int check_case_folding()
+{
+  uint32_t c;
+  if ((c = lex::case_folding::check()) != UINT32_MAX) {
+    fprintf(stderr, "The case folding orbit of U+%04X is broken.\n", c);
+    return -1;
+  }
+
+  printf("The case folding table is consistent.\n");
+  return 0;
+}
 
 int main(int argc, const char** argv)
 {
-  if (argc != 2) {
-    fprintf(stderr, "Usage: %s <regular-expression>\n", argv[0]);
+  bool print_stats = false;
+  bool reverse = false;
+  bool plan = false;
+  unsigned flags = 0;
+  size_t nthreads = 1;
+  const char* expr = nullptr;
+  const char* literals_file = nullptr;
+  const char* batch_file = nullptr;
+  const char* cache_dir = nullptr;
+  const char* captures_input = nullptr;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--stats") == 0) {
+      print_stats = true;
+    } else if (strcmp(argv[i], "--reverse") == 0) {
+      reverse = true;
+    } else if (strcmp(argv[i], "--plan") == 0) {
+      plan = true;
+    } else if ((strcmp(argv[i], "--check-case-folding") == 0) && (argc == 2)) {
+      return check_case_folding();
+    } else if (strcmp(argv[i], "--utf8") == 0) {
+      flags |= lex::regular_expression::utf8;
+    } else if (strcmp(argv[i], "--ignore-case") == 0) {
+      flags |= lex::regular_expression::icase;
+    } else if ((strcmp(argv[i], "--threads") == 0) && (i + 1 < argc)) {
+      nthreads = strtoul(argv[++i], nullptr, 10);
+    } else if ((strcmp(argv[i], "--literals") == 0) && (i + 1 < argc)) {
+      literals_file = argv[++i];
+    } else if ((strcmp(argv[i], "--batch") == 0) && (i + 1 < argc)) {
+      batch_file = argv[++i];
+    } else if ((strcmp(argv[i], "--cache") == 0) && (i + 1 < argc)) {
+      cache_dir = argv[++i];
+    } else if ((strcmp(argv[i], "--captures") == 0) && (i + 1 < argc)) {
+      captures_input = argv[++i];
+    } else if (!expr) {
+      expr = argv[i];
+    } else {
+      usage(argv[0]);
+      return -1;
+    }
+  }
+
+  if (batch_file) {
+    if ((expr) || (literals_file) || (print_stats)) {
+      usage(argv[0]);
+      return -1;
+    }
+
+    return compile_batch(batch_file, flags, nthreads);
+  }
+
+  if ((!expr) && (!literals_file)) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  if ((reverse) && ((literals_file) || (cache_dir))) {
+    usage(argv[0]);
     return -1;
   }
 
+  if (plan) {
+    if ((!expr) || (literals_file) || (cache_dir) || (reverse) ||
+        (captures_input)) {
+      usage(argv[0]);
+      return -1;
+    }
+
+    return print_plan(expr, flags, print_stats);
+  }
+
+  if (captures_input) {
+    if ((!expr) || (literals_file) || (cache_dir) || (reverse) ||
+        (print_stats)) {
+      usage(argv[0]);
+      return -1;
+    }
+
+    return print_captures(expr, captures_input, flags);
+  }
+
+  if (cache_dir) {
+    if ((literals_file) || (print_stats)) {
+      usage(argv[0]);
+      return -1;
+    }
+
+    // Load the DFA from the cache (or build it and save it in the cache).
+    lex::compile_cache cache(cache_dir);
+    lex::compiled_dfa dfa;
+
+    if (!cache.compile(expr, flags, dfa)) {
+      fprintf(stderr, "Error compiling regular expression.\n");
+      return -1;
+    }
+
+    dfa.print();
+
+    return 0;
+  }
+
+  lex::stats st;
+
   // Parse regular expression and build syntax tree.
   lex::regular_expression regex;
-  if (regex.parse(argv[1])) {
-    // Build DFA.
+  regex.set_flags(flags);
+
+  if ((!expr) || (regex.parse(expr, print_stats ? &st : nullptr))) {
     lex::dfa dfa;
-    if (dfa.build(regex)) {
+    dfa.set_threads(nthreads);
+
+    bool built;
+
+    if (literals_file) {
+      char* data = nullptr;
+      char** literals = nullptr;
+      size_t count = 0;
+
+      if (!load_literals(literals_file, data, literals, count)) {
+        fprintf(stderr, "Error loading literals from '%s'.\n", literals_file);
+
+        free(literals);
+        free(data);
+
+        return -1;
+      }
+
+      // Build DFA from the literals (and the regular expression).
+      built = dfa.build(literals,
+                        count,
+                        expr ? &regex : nullptr,
+                        print_stats ? &st : nullptr);
+
+      free(literals);
+      free(data);
+    } else {
+      // Build DFA (or reverse DFA).
+      built = reverse ?
+                dfa.build_reverse(regex, false, print_stats ? &st : nullptr) :
+                dfa.build(regex, print_stats ? &st : nullptr);
+    }
+
+    if (built) {
       dfa.print();
+
+      if (print_stats) {
+        st.print();
+      }
+
       return 0;
     } else {
       fprintf(stderr, "Error building DFA.\n");